@@ -5,6 +5,8 @@
 #include <string>
 #include <memory>
 #include <set>
+#include <map>
+#include <unordered_map>
 
 // Forward declarations
 struct Type;
@@ -21,6 +23,56 @@ enum class BinaryOp { Add, Sub, Mul, Div, And, Or, Eq, NotEq, Lt, Lte, Gt, Gte }
 struct Node {
     virtual ~Node() = default;
     virtual void print(std::ostream& os) const = 0; // print function
+
+    // Appends this node's children to `out`, in the order print() visits them.
+    virtual void children(std::vector<const Node*>&) const {}
+
+    // Moves this node's children into `out`, leaving it a leaf. Interned
+    // types are not owned by the node and are left alone.
+    virtual void release_children(std::vector<std::unique_ptr<Node>>&) {}
+
+    // Appends the slots holding this node's expression children to `out`,
+    // so a pass can replace them in place. The Place of a Val and the
+    // FunCall of a CallExp aren't expressions, so they are looked through.
+    virtual void exp_slots(std::vector<std::unique_ptr<Exp>*>&) {}
+
+protected:
+    // Called from the destructor of every node that owns children. Frees the
+    // subtree with an explicit worklist instead of letting ~unique_ptr
+    // recurse, so long chains like `a + b + c + ...` can't overflow the stack.
+    void dismantle() {
+        std::vector<std::unique_ptr<Node>> work;
+        release_children(work);
+        while (!work.empty()) {
+            std::unique_ptr<Node> node = std::move(work.back());
+            work.pop_back();
+            node->release_children(work);
+        }
+    }
+
+    static void collect(const Node* child, std::vector<const Node*>& out) {
+        if (child) out.push_back(child);
+    }
+
+    template <typename T>
+    static void collect(const std::unique_ptr<T>& child, std::vector<const Node*>& out) {
+        collect(child.get(), out);
+    }
+
+    template <typename T>
+    static void collect(const std::vector<T>& children, std::vector<const Node*>& out) {
+        for (const auto& child : children) collect(child, out);
+    }
+
+    template <typename T>
+    static void release(std::unique_ptr<T>& child, std::vector<std::unique_ptr<Node>>& out) {
+        if (child) out.push_back(std::move(child));
+    }
+
+    template <typename T>
+    static void release(std::vector<std::unique_ptr<T>>& children, std::vector<std::unique_ptr<Node>>& out) {
+        for (auto& child : children) release(child, out);
+    }
 };
 
 // Overload << operator to make printing easy
@@ -58,11 +110,16 @@ struct StructType : public Type {
 };
 
 struct FnType : public Type {
-    std::vector<std::unique_ptr<Type>> param_types;
-    std::unique_ptr<Type> return_type;
+    std::vector<const Type*> param_types;
+    const Type* return_type;
+
+    FnType(std::vector<const Type*> ptrs, const Type* rt)
+    : param_types(std::move(ptrs)), return_type(rt) {}
 
-    FnType(std::vector<std::unique_ptr<Type>> ptrs, std::unique_ptr<Type> rt)
-    : param_types(std::move(ptrs)), return_type(std::move(rt)) {}
+    void children(std::vector<const Node*>& out) const override {
+        collect(param_types, out);
+        collect(return_type, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "Fn([";
@@ -77,8 +134,12 @@ struct FnType : public Type {
 };
 
 struct PtrType : public Type {
-    std::unique_ptr<Type> base_type;
-    explicit PtrType(std::unique_ptr<Type> bt) : base_type(std::move(bt)) {}
+    const Type* base_type;
+    explicit PtrType(const Type* bt) : base_type(bt) {}
+
+    void children(std::vector<const Node*>& out) const override {
+        collect(base_type, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "Ptr(";
@@ -88,8 +149,12 @@ struct PtrType : public Type {
 };
 
 struct ArrayType : public Type {
-    std::unique_ptr<Type> element_type;
-    explicit ArrayType(std::unique_ptr<Type> et) : element_type(std::move(et)) {}
+    const Type* element_type;
+    explicit ArrayType(const Type* et) : element_type(et) {}
+
+    void children(std::vector<const Node*>& out) const override {
+        collect(element_type, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "Array(";
@@ -104,12 +169,70 @@ struct NilType : public Type {
     }
 };
 
+// Hash-consing table for types. Every structurally distinct type is built
+// once and shared by all the nodes that mention it, so two types are equal
+// exactly when their pointers are. The table owns its types; nodes only
+// point into it.
+class TypeInterner {
+public:
+    const Type* int_type() { return &m_int; }
+    const Type* nil_type() { return &m_nil; }
+
+    const Type* struct_type(const std::string& name) {
+        auto it = m_structs.find(name);
+        if (it != m_structs.end()) return it->second;
+        return m_structs.emplace(name, own(std::make_unique<StructType>(name))).first->second;
+    }
+
+    const Type* ptr_type(const Type* base) {
+        const Type*& slot = m_ptrs[base];
+        if (!slot) slot = own(std::make_unique<PtrType>(base));
+        return slot;
+    }
+
+    const Type* array_type(const Type* element) {
+        const Type*& slot = m_arrays[element];
+        if (!slot) slot = own(std::make_unique<ArrayType>(element));
+        return slot;
+    }
+
+    const Type* fn_type(std::vector<const Type*> params, const Type* ret) {
+        auto key = std::make_pair(std::move(params), ret);
+        auto it = m_fns.find(key);
+        if (it != m_fns.end()) return it->second;
+        const Type* fn = own(std::make_unique<FnType>(key.first, ret));
+        m_fns.emplace(std::move(key), fn);
+        return fn;
+    }
+
+    // Number of distinct types built so far.
+    size_t size() const { return 2 + m_owned.size(); }
+
+private:
+    IntType m_int;
+    NilType m_nil;
+    std::vector<std::unique_ptr<Type>> m_owned;
+    std::unordered_map<std::string, const Type*> m_structs;
+    std::unordered_map<const Type*, const Type*> m_ptrs;
+    std::unordered_map<const Type*, const Type*> m_arrays;
+    std::map<std::pair<std::vector<const Type*>, const Type*>, const Type*> m_fns;
+
+    const Type* own(std::unique_ptr<Type> type) {
+        m_owned.push_back(std::move(type));
+        return m_owned.back().get();
+    }
+};
+
 // Decl
 struct Decl : public Node {
     std::string name;
-    std::unique_ptr<Type> type;
+    const Type* type;
 
-    Decl(std::string n, std::unique_ptr<Type> t) : name(std::move(n)), type(std::move(t)) {}
+    Decl(std::string n, const Type* t) : name(std::move(n)), type(t) {}
+
+    void children(std::vector<const Node*>& out) const override {
+        collect(type, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "Decl { name: \"" << name << "\", typ: ";
@@ -152,6 +275,17 @@ struct Val : public Exp {
     std::unique_ptr<Place> place;
     explicit Val(std::unique_ptr<Place> p) : place(std::move(p)) {}
 
+    ~Val() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(place, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        place->exp_slots(out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(place, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Val(";
         place->print(os);
@@ -182,6 +316,23 @@ struct Select : public Exp {
     Select(std::unique_ptr<Exp> g, std::unique_ptr<Exp> t, std::unique_ptr<Exp> f) 
     : guard(std::move(g)), tt(std::move(t)), ff(std::move(f)) {}
 
+    ~Select() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(guard, out);
+        release(tt, out);
+        release(ff, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&guard);
+        out.push_back(&tt);
+        out.push_back(&ff);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(guard, out);
+        collect(tt, out);
+        collect(ff, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Select { guard: ";
         guard->print(os);
@@ -199,6 +350,17 @@ struct UnOp : public Exp {
 
     UnOp(UnaryOp o, std::unique_ptr<Exp> e) : op(o), exp(std::move(e)) {}
 
+    ~UnOp() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(exp, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&exp);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(exp, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "UnOp(";
         switch (op) {
@@ -219,6 +381,20 @@ struct BinOp : public Exp {
     BinOp(BinaryOp o, std::unique_ptr<Exp> l, std::unique_ptr<Exp> r) 
     : op(o), left(std::move(l)), right(std::move(r)) {}
 
+    ~BinOp() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(left, out);
+        release(right, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&left);
+        out.push_back(&right);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(left, out);
+        collect(right, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "BinOp { op: ";
         switch (op) {
@@ -244,8 +420,12 @@ struct BinOp : public Exp {
 };
 
 struct NewSingle : public Exp {
-    std::unique_ptr<Type> type;
-    explicit NewSingle(std::unique_ptr<Type> t) : type(std::move(t)) {}
+    const Type* type;
+    explicit NewSingle(const Type* t) : type(t) {}
+
+    void children(std::vector<const Node*>& out) const override {
+        collect(type, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "NewSingle(";
@@ -255,11 +435,23 @@ struct NewSingle : public Exp {
 };
 
 struct NewArray : public Exp {
-    std::unique_ptr<Type> type;
+    const Type* type;
     std::unique_ptr<Exp> size;
 
-    NewArray(std::unique_ptr<Type> t, std::unique_ptr<Exp> s) 
-    : type(std::move(t)), size(std::move(s)) {}
+    NewArray(const Type* t, std::unique_ptr<Exp> s) 
+    : type(t), size(std::move(s)) {}
+
+    ~NewArray() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(size, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&size);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(type, out);
+        collect(size, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "NewArray(";
@@ -275,6 +467,17 @@ struct Deref : public Place {
     std::unique_ptr<Exp> exp;
     explicit Deref(std::unique_ptr<Exp> e) : exp(std::move(e)) {}
 
+    ~Deref() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(exp, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&exp);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(exp, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Deref(";
         exp->print(os);
@@ -289,6 +492,20 @@ struct ArrayAccess : public Place {
     ArrayAccess(std::unique_ptr<Exp> arr, std::unique_ptr<Exp> idx) 
     : array(std::move(arr)), index(std::move(idx)) {}
 
+    ~ArrayAccess() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(array, out);
+        release(index, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&array);
+        out.push_back(&index);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(array, out);
+        collect(index, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "ArrayAccess { array: ";
         array->print(os);
@@ -305,6 +522,17 @@ struct FieldAccess : public Place {
     FieldAccess(std::unique_ptr<Exp> p, std::string f) 
     : ptr(std::move(p)), field(std::move(f)) {}
 
+    ~FieldAccess() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(ptr, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&ptr);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(ptr, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "FieldAccess { ptr: ";
         ptr->print(os);
@@ -320,6 +548,20 @@ struct FunCall: Node {
     FunCall(std::unique_ptr<Exp> c, std::vector<std::unique_ptr<Exp>> a) 
     : callee(std::move(c)), args(std::move(a)) {}
 
+    ~FunCall() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(callee, out);
+        release(args, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        out.push_back(&callee);
+        for (auto& arg : args) out.push_back(&arg);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(callee, out);
+        collect(args, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "FunCall { callee: ";
         callee->print(os);
@@ -336,6 +578,17 @@ struct CallExp : public Exp {
     std::unique_ptr<FunCall> fun_call;
     explicit CallExp(std::unique_ptr<FunCall> fc) : fun_call(std::move(fc)) {}
 
+    ~CallExp() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(fun_call, out);
+    }
+    void exp_slots(std::vector<std::unique_ptr<Exp>*>& out) override {
+        fun_call->exp_slots(out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(fun_call, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Call(";
         fun_call->print(os);
@@ -364,6 +617,16 @@ struct Assign : public Stmt {
     Assign(std::unique_ptr<Place> p, std::unique_ptr<Exp> e) 
     : place(std::move(p)), exp(std::move(e)) {}
 
+    ~Assign() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(place, out);
+        release(exp, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(place, out);
+        collect(exp, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Assign(";
         place->print(os);
@@ -377,6 +640,14 @@ struct CallStmt : public Stmt {
     std::unique_ptr<FunCall> fun_call;
     explicit CallStmt(std::unique_ptr<FunCall> fc) : fun_call(std::move(fc)) {}
 
+    ~CallStmt() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(fun_call, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(fun_call, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Call(";
         fun_call->print(os);
@@ -392,6 +663,18 @@ struct If : public Stmt {
     If(std::unique_ptr<Exp> g, std::vector<std::unique_ptr<Stmt>> t, std::vector<std::unique_ptr<Stmt>> f) 
     : guard(std::move(g)), tt(std::move(t)), ff(std::move(f)) {}
 
+    ~If() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(guard, out);
+        release(tt, out);
+        release(ff, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(guard, out);
+        collect(tt, out);
+        collect(ff, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "If { guard: ";
         guard->print(os);
@@ -416,6 +699,16 @@ struct While : public Stmt {
     While(std::unique_ptr<Exp> g, std::vector<std::unique_ptr<Stmt>> b) 
     : guard(std::move(g)), body(std::move(b)) {}
 
+    ~While() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(guard, out);
+        release(body, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(guard, out);
+        collect(body, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "While(";
         guard->print(os);
@@ -443,6 +736,14 @@ struct Continue : public Stmt {
 struct Return : public Stmt {
     std::unique_ptr<Exp> exp;
     explicit Return(std::unique_ptr<Exp> e) : exp(std::move(e)) {}
+    ~Return() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(exp, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(exp, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Return(";
         exp->print(os);
@@ -452,12 +753,54 @@ struct Return : public Stmt {
 
 // Top level nodes
 
+// A function body the parser left to parse later (see
+// BasicParser::defer_function_bodies).
+struct DeferredBody {
+    virtual ~DeferredBody() = default;
+    // Parses the statements; throws ParseError if they don't parse.
+    virtual std::vector<std::unique_ptr<Stmt>> parse() const = 0;
+};
+
 struct FunctionDef : public Node {
     std::string name;
     std::vector<std::unique_ptr<Decl>> params;
-    std::unique_ptr<Type> rettype;
+    const Type* rettype = nullptr;
     std::vector<std::unique_ptr<Decl>> locals;
-    std::vector<std::unique_ptr<Stmt>> stmts;
+
+    // The statements of the body. If the parser deferred the body (see
+    // BasicParser::defer_function_bodies), the first call parses it, and
+    // throws the ParseError if that fails. Single-threaded: a deferred body
+    // also interns into the program's TypeInterner, so call stmts() on the
+    // functions of a program from one thread.
+    std::vector<std::unique_ptr<Stmt>>& stmts() {
+        parse_body();
+        return m_stmts;
+    }
+    const std::vector<std::unique_ptr<Stmt>>& stmts() const {
+        parse_body();
+        return m_stmts;
+    }
+
+    // Whether the statements are there yet: true unless the body was
+    // deferred and stmts() hasn't been called since.
+    bool body_parsed() const { return !m_deferred_body; }
+    // Leaves the statements to `body` until they are first asked for.
+    void defer_body(std::unique_ptr<DeferredBody> body) { m_deferred_body = std::move(body); }
+
+    ~FunctionDef() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(params, out);
+        release(locals, out);
+        release(m_stmts, out);
+    }
+    // Leaves out the statements of a body that is still deferred, so a
+    // traversal never parses; call stmts() first to include them.
+    void children(std::vector<const Node*>& out) const override {
+        collect(params, out);
+        collect(rettype, out);
+        collect(locals, out);
+        if (body_parsed()) collect(m_stmts, out);
+    }
 
     void print(std::ostream& os) const override {
         os << "Function { name: \"" << name << "\", ";
@@ -475,18 +818,41 @@ struct FunctionDef : public Node {
         }
         os << "}, ";
         os << "stmts: [";
-        for (size_t i = 0; i < stmts.size(); ++i) {
-            stmts[i]->print(os);
-            if (i < stmts.size() - 1) os << ", ";
+        const auto& body = stmts();
+        for (size_t i = 0; i < body.size(); ++i) {
+            body[i]->print(os);
+            if (i < body.size() - 1) os << ", ";
         }
         os << "] }";
     }
+
+private:
+    // Set while the body is deferred; dropped once it has been parsed.
+    mutable std::unique_ptr<DeferredBody> m_deferred_body;
+    mutable std::vector<std::unique_ptr<Stmt>> m_stmts;
+
+    void parse_body() const {
+        if (m_deferred_body) {
+            // Dropped after, not before: if it throws, it throws again on
+            // the next call instead of leaving an empty body behind.
+            m_stmts = m_deferred_body->parse();
+            m_deferred_body.reset();
+        }
+    }
 };
 
 struct StructDef : public Node {
     std::string name;
     std::vector<std::unique_ptr<Decl>> fields;
 
+    ~StructDef() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(fields, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(fields, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Struct { name: \"" << name << "\", fields: {";
         for (size_t i = 0; i < fields.size(); ++i) {
@@ -498,10 +864,24 @@ struct StructDef : public Node {
 };
 
 struct Program : public Node {
+    // Owns every Type the nodes below point to.
+    std::unique_ptr<TypeInterner> types = std::make_unique<TypeInterner>();
     std::vector<std::unique_ptr<StructDef>> structs;
     std::vector<std::unique_ptr<Decl>> externs;
     std::vector<std::unique_ptr<FunctionDef>> functions;
 
+    ~Program() override { dismantle(); }
+    void release_children(std::vector<std::unique_ptr<Node>>& out) override {
+        release(structs, out);
+        release(externs, out);
+        release(functions, out);
+    }
+    void children(std::vector<const Node*>& out) const override {
+        collect(structs, out);
+        collect(externs, out);
+        collect(functions, out);
+    }
+
     void print(std::ostream& os) const override {
         os << "Program { structs: {";
         for (const auto& s : structs) {
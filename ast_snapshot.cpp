@@ -0,0 +1,627 @@
+#include "ast_snapshot.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snapshot {
+
+static const char MAGIC[8] = {'C', 'F', 'L', 'A', 'T', 'A', 'S', 'T'};
+static const uint32_t VERSION = 1;
+
+// How many fields of each shape a record of the given kind has.
+struct Layout {
+    uint8_t strs;
+    uint8_t children;
+    uint8_t num_words;
+    uint8_t lists;
+};
+
+static Layout layout_of(Kind kind) {
+    switch (kind) {
+        case Kind::IntType:     return {0, 0, 0, 0};
+        case Kind::StructType:  return {1, 0, 0, 0};
+        case Kind::FnType:      return {0, 1, 0, 1};
+        case Kind::PtrType:     return {0, 1, 0, 0};
+        case Kind::ArrayType:   return {0, 1, 0, 0};
+        case Kind::NilType:     return {0, 0, 0, 0};
+        case Kind::Decl:        return {1, 1, 0, 0};
+        case Kind::Id:          return {1, 0, 0, 0};
+        case Kind::Deref:       return {0, 1, 0, 0};
+        case Kind::ArrayAccess: return {0, 2, 0, 0};
+        case Kind::FieldAccess: return {1, 1, 0, 0};
+        case Kind::Val:         return {0, 1, 0, 0};
+        case Kind::Num:         return {0, 0, 2, 0};
+        case Kind::NilExp:      return {0, 0, 0, 0};
+        case Kind::Select:      return {0, 3, 0, 0};
+        case Kind::UnOp:        return {0, 1, 0, 0};
+        case Kind::BinOp:       return {0, 2, 0, 0};
+        case Kind::NewSingle:   return {0, 1, 0, 0};
+        case Kind::NewArray:    return {0, 2, 0, 0};
+        case Kind::CallExp:     return {0, 1, 0, 0};
+        case Kind::FunCall:     return {0, 1, 0, 1};
+        case Kind::Assign:      return {0, 2, 0, 0};
+        case Kind::CallStmt:    return {0, 1, 0, 0};
+        case Kind::If:          return {0, 1, 0, 2};
+        case Kind::While:       return {0, 1, 0, 1};
+        case Kind::Break:       return {0, 0, 0, 0};
+        case Kind::Continue:    return {0, 0, 0, 0};
+        case Kind::Return:      return {0, 1, 0, 0};
+        case Kind::FunctionDef: return {1, 1, 0, 3};
+        case Kind::StructDef:   return {1, 0, 0, 1};
+        case Kind::Program:     return {0, 0, 0, 3};
+    }
+    return {0, 0, 0, 0};
+}
+
+// --- Views ---
+
+std::string_view NodeView::str(size_t i) const {
+    return std::string_view(m_strings + m_record[1 + i]);
+}
+
+NodeView NodeView::child(size_t i) const {
+    Layout l = layout_of(kind());
+    return NodeView(m_record - m_record[1 + l.strs + i], m_strings);
+}
+
+long long NodeView::num() const {
+    Layout l = layout_of(kind());
+    const uint32_t* at = m_record + 1 + l.strs + l.children;
+    uint64_t bits = static_cast<uint64_t>(at[0]) | (static_cast<uint64_t>(at[1]) << 32);
+    long long value;
+    std::memcpy(&value, &bits, sizeof value);
+    return value;
+}
+
+ListView NodeView::list(size_t i) const {
+    Layout l = layout_of(kind());
+    const uint32_t* count = m_record + 1 + l.strs + l.children + l.num_words;
+    // Lists are variable length, so skip over the ones before it.
+    for (size_t skip = 0; skip < i; ++skip) {
+        count += 1 + *count;
+    }
+    return ListView(count, m_record, m_strings);
+}
+
+static void print_list(std::ostream& os, const ListView& list) {
+    for (size_t i = 0; i < list.size(); ++i) {
+        list[i].print(os);
+        if (i < list.size() - 1) os << ", ";
+    }
+}
+
+static const char* unary_op_name(UnaryOp op) {
+    switch (op) {
+        case UnaryOp::Neg: return "Neg";
+        case UnaryOp::Not: return "Not";
+    }
+    return "";
+}
+
+static const char* binary_op_name(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::Add: return "Add";
+        case BinaryOp::Sub: return "Sub";
+        case BinaryOp::Mul: return "Mul";
+        case BinaryOp::Div: return "Div";
+        case BinaryOp::And: return "And";
+        case BinaryOp::Or: return "Or";
+        case BinaryOp::Eq: return "Eq";
+        case BinaryOp::NotEq: return "NotEq";
+        case BinaryOp::Lt: return "Lt";
+        case BinaryOp::Lte: return "Lte";
+        case BinaryOp::Gt: return "Gt";
+        case BinaryOp::Gte: return "Gte";
+    }
+    return "";
+}
+
+// Mirrors the print() overrides in ast.hpp.
+void NodeView::print(std::ostream& os) const {
+    switch (kind()) {
+        case Kind::IntType: os << "Int"; break;
+        case Kind::StructType: os << "Struct(\"" << str() << "\")"; break;
+        case Kind::FnType:
+            os << "Fn([";
+            print_list(os, list(0));
+            os << "], ";
+            child(0).print(os);
+            os << ")";
+            break;
+        case Kind::PtrType: os << "Ptr("; child(0).print(os); os << ")"; break;
+        case Kind::ArrayType: os << "Array("; child(0).print(os); os << ")"; break;
+        case Kind::NilType: os << "Nil"; break;
+        case Kind::Decl:
+            os << "Decl { name: \"" << str() << "\", typ: ";
+            child(0).print(os);
+            os << " }";
+            break;
+        case Kind::Id: os << "Id(\"" << str() << "\")"; break;
+        case Kind::Deref: os << "Deref("; child(0).print(os); os << ")"; break;
+        case Kind::ArrayAccess:
+            os << "ArrayAccess { array: ";
+            child(0).print(os);
+            os << ", idx: ";
+            child(1).print(os);
+            os << " }";
+            break;
+        case Kind::FieldAccess:
+            os << "FieldAccess { ptr: ";
+            child(0).print(os);
+            os << ", field: \"" << str() << "\" }";
+            break;
+        case Kind::Val: os << "Val("; child(0).print(os); os << ")"; break;
+        case Kind::Num: os << "Num(" << num() << ")"; break;
+        case Kind::NilExp: os << "Nil"; break;
+        case Kind::Select:
+            os << "Select { guard: ";
+            child(0).print(os);
+            os << ", tt: ";
+            child(1).print(os);
+            os << ", ff: ";
+            child(2).print(os);
+            os << " }";
+            break;
+        case Kind::UnOp:
+            os << "UnOp(" << unary_op_name(unary_op()) << ", ";
+            child(0).print(os);
+            os << ")";
+            break;
+        case Kind::BinOp:
+            os << "BinOp { op: " << binary_op_name(binary_op()) << ", left: ";
+            child(0).print(os);
+            os << ", right: ";
+            child(1).print(os);
+            os << " }";
+            break;
+        case Kind::NewSingle: os << "NewSingle("; child(0).print(os); os << ")"; break;
+        case Kind::NewArray:
+            os << "NewArray(";
+            child(0).print(os);
+            os << ", ";
+            child(1).print(os);
+            os << ")";
+            break;
+        case Kind::CallExp:
+        case Kind::CallStmt:
+            os << "Call(";
+            child(0).print(os);
+            os << ")";
+            break;
+        case Kind::FunCall:
+            os << "FunCall { callee: ";
+            child(0).print(os);
+            os << ", args: [";
+            print_list(os, list(0));
+            os << "] }";
+            break;
+        case Kind::Assign:
+            os << "Assign(";
+            child(0).print(os);
+            os << ", ";
+            child(1).print(os);
+            os << ")";
+            break;
+        case Kind::If:
+            os << "If { guard: ";
+            child(0).print(os);
+            os << ", tt: [";
+            print_list(os, list(0));
+            os << "], ff: [";
+            print_list(os, list(1));
+            os << "] }";
+            break;
+        case Kind::While:
+            os << "While(";
+            child(0).print(os);
+            os << ", [";
+            print_list(os, list(0));
+            os << "])";
+            break;
+        case Kind::Break: os << "Break"; break;
+        case Kind::Continue: os << "Continue"; break;
+        case Kind::Return: os << "Return("; child(0).print(os); os << ")"; break;
+        case Kind::FunctionDef:
+            os << "Function { name: \"" << str() << "\", ";
+            os << "prms: [";
+            print_list(os, list(0));
+            os << "], rettyp: ";
+            child(0).print(os);
+            os << ", locals: {";
+            print_list(os, list(1));
+            os << "}, ";
+            os << "stmts: [";
+            print_list(os, list(2));
+            os << "] }";
+            break;
+        case Kind::StructDef:
+            os << "Struct { name: \"" << str() << "\", fields: {";
+            print_list(os, list(0));
+            os << "} }";
+            break;
+        case Kind::Program:
+            os << "Program { structs: {";
+            print_list(os, list(0));
+            os << "}, externs: {";
+            print_list(os, list(1));
+            os << "}, functions: {";
+            print_list(os, list(2));
+            os << "}}";
+            break;
+    }
+}
+
+size_t count_nodes(const NodeView& root) {
+    size_t count = 0;
+    std::vector<NodeView> work{root};
+    while (!work.empty()) {
+        NodeView node = work.back();
+        work.pop_back();
+        ++count;
+        Layout l = layout_of(node.kind());
+        for (size_t i = 0; i < l.children; ++i) work.push_back(node.child(i));
+        for (size_t i = 0; i < l.lists; ++i) {
+            ListView list = node.list(i);
+            for (size_t j = 0; j < list.size(); ++j) work.push_back(list[j]);
+        }
+    }
+    return count;
+}
+
+// --- Loading ---
+
+static bool valid_op(Kind kind, uint32_t op) {
+    switch (kind) {
+        case Kind::UnOp: return op <= static_cast<uint32_t>(UnaryOp::Not);
+        case Kind::BinOp: return op <= static_cast<uint32_t>(BinaryOp::Gte);
+        default: return op == 0;
+    }
+}
+
+// Walks every record once so the views can trust what they read: each
+// record has a known kind and fits in the node words, each string offset
+// lands in the NUL-terminated pool, each child distance points back to the
+// start of an earlier record, and the root is a Program.
+static bool valid_records(const SnapshotHeader* header) {
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(header + 1);
+    const char* strings = reinterpret_cast<const char*>(words + header->node_words);
+    size_t size = header->node_words;
+    if (header->string_bytes > 0 && strings[header->string_bytes - 1] != '\0') return false;
+
+    std::vector<bool> starts(size, false);
+    auto valid_child = [&](size_t at, uint32_t distance) {
+        return distance > 0 && distance <= at && starts[at - distance];
+    };
+    size_t at = 0;
+    while (at < size) {
+        uint32_t word = words[at];
+        if ((word & 0xff) > static_cast<uint32_t>(Kind::Program)) return false;
+        Kind kind = static_cast<Kind>(word & 0xff);
+        if (!valid_op(kind, word >> 8)) return false;
+        Layout l = layout_of(kind);
+        size_t fixed = 1 + l.strs + l.children + l.num_words;
+        if (fixed > size - at) return false;
+        for (size_t i = 0; i < l.strs; ++i) {
+            if (words[at + 1 + i] >= header->string_bytes) return false;
+        }
+        for (size_t i = 0; i < l.children; ++i) {
+            if (!valid_child(at, words[at + 1 + l.strs + i])) return false;
+        }
+        size_t next = at + fixed;
+        for (size_t i = 0; i < l.lists; ++i) {
+            if (next >= size || words[next] > size - next - 1) return false;
+            size_t count = words[next++];
+            for (size_t j = 0; j < count; ++j, ++next) {
+                if (!valid_child(at, words[next])) return false;
+            }
+        }
+        starts[at] = true;
+        at = next;
+    }
+    return starts[header->root] && static_cast<Kind>(words[header->root] & 0xff) == Kind::Program;
+}
+
+Snapshot::Snapshot(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("snapshot error: could not open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        throw std::runtime_error("snapshot error: " + path + " is too small");
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m_data == MAP_FAILED) {
+        m_data = nullptr;
+        throw std::runtime_error("snapshot error: could not map " + path);
+    }
+
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(m_data);
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof MAGIC) == 0
+        && header->version == VERSION
+        && header->root < header->node_words
+        && header->node_words <= m_size / sizeof(uint32_t) && header->string_bytes <= m_size
+        && sizeof(SnapshotHeader) + header->node_words * sizeof(uint32_t) + header->string_bytes == m_size
+        && valid_records(header);
+    if (!valid) {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        throw std::runtime_error("snapshot error: " + path + " is not a valid snapshot");
+    }
+}
+
+Snapshot::~Snapshot() {
+    if (m_data) ::munmap(m_data, m_size);
+}
+
+NodeView Snapshot::root() const {
+    const SnapshotHeader* header = static_cast<const SnapshotHeader*>(m_data);
+    const uint32_t* words = reinterpret_cast<const uint32_t*>(header + 1);
+    const char* strings = reinterpret_cast<const char*>(words + header->node_words);
+    return NodeView(words + header->root, strings);
+}
+
+// --- Writing ---
+
+namespace {
+
+Kind kind_of(const Node& node) {
+    static const std::unordered_map<std::type_index, Kind> kinds = {
+        {typeid(IntType), Kind::IntType},         {typeid(StructType), Kind::StructType},
+        {typeid(FnType), Kind::FnType},           {typeid(PtrType), Kind::PtrType},
+        {typeid(ArrayType), Kind::ArrayType},     {typeid(NilType), Kind::NilType},
+        {typeid(Decl), Kind::Decl},               {typeid(Id), Kind::Id},
+        {typeid(Deref), Kind::Deref},             {typeid(ArrayAccess), Kind::ArrayAccess},
+        {typeid(FieldAccess), Kind::FieldAccess}, {typeid(Val), Kind::Val},
+        {typeid(Num), Kind::Num},                 {typeid(NilExp), Kind::NilExp},
+        {typeid(Select), Kind::Select},           {typeid(UnOp), Kind::UnOp},
+        {typeid(BinOp), Kind::BinOp},             {typeid(NewSingle), Kind::NewSingle},
+        {typeid(NewArray), Kind::NewArray},       {typeid(CallExp), Kind::CallExp},
+        {typeid(FunCall), Kind::FunCall},         {typeid(Assign), Kind::Assign},
+        {typeid(CallStmt), Kind::CallStmt},       {typeid(If), Kind::If},
+        {typeid(While), Kind::While},             {typeid(Break), Kind::Break},
+        {typeid(Continue), Kind::Continue},       {typeid(Return), Kind::Return},
+        {typeid(FunctionDef), Kind::FunctionDef}, {typeid(StructDef), Kind::StructDef},
+        {typeid(Program), Kind::Program},
+    };
+    auto it = kinds.find(typeid(node));
+    if (it == kinds.end()) {
+        throw std::runtime_error("snapshot error: unknown node kind");
+    }
+    return it->second;
+}
+
+bool is_type(Kind kind) {
+    return kind <= Kind::NilType;
+}
+
+// How a node's children() split into fields, in children() order. A fixed
+// child is one entry of size 1; a list field is one entry of its length.
+struct Fields {
+    size_t count = 0;
+    size_t size[4];
+    bool list[4];
+
+    void fixed() { add(1, false); }
+    void add(size_t n, bool is_list) {
+        size[count] = n;
+        list[count++] = is_list;
+    }
+};
+
+Fields fields_of(const Node& node, Kind kind, size_t children) {
+    Fields f;
+    switch (kind) {
+        case Kind::FnType:
+            f.add(static_cast<const FnType&>(node).param_types.size(), true);
+            f.fixed();
+            break;
+        case Kind::FunCall:
+            f.fixed();
+            f.add(static_cast<const FunCall&>(node).args.size(), true);
+            break;
+        case Kind::If: {
+            const If& n = static_cast<const If&>(node);
+            f.fixed();
+            f.add(n.tt.size(), true);
+            f.add(n.ff.size(), true);
+            break;
+        }
+        case Kind::While:
+            f.fixed();
+            f.add(static_cast<const While&>(node).body.size(), true);
+            break;
+        case Kind::FunctionDef: {
+            const FunctionDef& n = static_cast<const FunctionDef&>(node);
+            f.add(n.params.size(), true);
+            f.fixed();
+            f.add(n.locals.size(), true);
+            f.add(n.stmts().size(), true);
+            break;
+        }
+        case Kind::StructDef:
+            f.add(static_cast<const StructDef&>(node).fields.size(), true);
+            break;
+        case Kind::Program: {
+            const Program& n = static_cast<const Program&>(node);
+            f.add(n.structs.size(), true);
+            f.add(n.externs.size(), true);
+            f.add(n.functions.size(), true);
+            break;
+        }
+        default:
+            for (size_t i = 0; i < children; ++i) f.fixed();
+            break;
+    }
+    return f;
+}
+
+// Emits records in post-order so every child offset points backwards. The
+// tree is walked with an explicit stack over Node::children(), so deep
+// expressions can't overflow the call stack.
+class Writer {
+public:
+    std::vector<uint32_t> words;
+    std::string strings;
+
+    uint32_t emit(const Node& root);
+
+private:
+    std::unordered_map<std::string, uint32_t> m_interned;
+    // Types are hash-consed, so each one is written once and shared.
+    std::unordered_map<const Node*, uint32_t> m_emitted_types;
+
+    // Records and strings are addressed with 32-bit offsets.
+    static void check_offset(size_t offset) {
+        if (offset > UINT32_MAX) {
+            throw std::runtime_error("snapshot error: program too large for a snapshot");
+        }
+    }
+
+    uint32_t begin(Kind kind, unsigned op = 0) {
+        check_offset(words.size());
+        uint32_t at = static_cast<uint32_t>(words.size());
+        words.push_back(static_cast<uint32_t>(kind) | (op << 8));
+        return at;
+    }
+
+    void put_str(const std::string& s) {
+        check_offset(strings.size());
+        auto [it, inserted] = m_interned.emplace(s, static_cast<uint32_t>(strings.size()));
+        if (inserted) {
+            strings.append(s);
+            strings.push_back('\0');
+        }
+        words.push_back(it->second);
+    }
+
+    void put_child(uint32_t at, uint32_t child) {
+        words.push_back(at - child);
+    }
+
+    void put_num(long long value) {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof bits);
+        words.push_back(static_cast<uint32_t>(bits));
+        words.push_back(static_cast<uint32_t>(bits >> 32));
+    }
+
+    // Writes the record of `node`, whose children are already at `kids`.
+    uint32_t put_record(const Node& node, Kind kind, const uint32_t* kids, size_t count);
+};
+
+uint32_t Writer::put_record(const Node& node, Kind kind, const uint32_t* kids, size_t count) {
+    unsigned op = 0;
+    if (kind == Kind::UnOp) op = static_cast<unsigned>(static_cast<const UnOp&>(node).op);
+    if (kind == Kind::BinOp) op = static_cast<unsigned>(static_cast<const BinOp&>(node).op);
+    uint32_t at = begin(kind, op);
+
+    switch (kind) {
+        case Kind::StructType: put_str(static_cast<const StructType&>(node).name); break;
+        case Kind::Decl: put_str(static_cast<const Decl&>(node).name); break;
+        case Kind::Id: put_str(static_cast<const Id&>(node).name); break;
+        case Kind::FieldAccess: put_str(static_cast<const FieldAccess&>(node).field); break;
+        case Kind::FunctionDef: put_str(static_cast<const FunctionDef&>(node).name); break;
+        case Kind::StructDef: put_str(static_cast<const StructDef&>(node).name); break;
+        case Kind::Num: put_num(static_cast<const Num&>(node).value); break;
+        default: break;
+    }
+
+    // Fixed children first, then each list behind its count.
+    Fields f = fields_of(node, kind, count);
+    const uint32_t* kid = kids;
+    for (size_t i = 0; i < f.count; kid += f.size[i++]) {
+        if (!f.list[i]) put_child(at, *kid);
+    }
+    kid = kids;
+    for (size_t i = 0; i < f.count; kid += f.size[i++]) {
+        if (!f.list[i]) continue;
+        words.push_back(static_cast<uint32_t>(f.size[i]));
+        for (size_t j = 0; j < f.size[i]; ++j) put_child(at, kid[j]);
+    }
+    return at;
+}
+
+uint32_t Writer::emit(const Node& root) {
+    struct Frame {
+        const Node* node;
+        Kind kind;
+        size_t first;  // index of the node's first child in `pending`
+        size_t next;   // index of the next child to visit
+    };
+    std::vector<const Node*> pending;  // children of every open frame
+    std::vector<uint32_t> done;        // records of the visited children
+    std::vector<Frame> stack;
+
+    auto open = [&](const Node& node) {
+        Kind kind = kind_of(node);
+        if (is_type(kind)) {
+            auto it = m_emitted_types.find(&node);
+            if (it != m_emitted_types.end()) {
+                done.push_back(it->second);
+                return;
+            }
+        }
+        // Parses a deferred body first, so children() sees its statements.
+        if (kind == Kind::FunctionDef) static_cast<const FunctionDef&>(node).stmts();
+        size_t first = pending.size();
+        node.children(pending);
+        stack.push_back({&node, kind, first, first});
+    };
+
+    open(root);
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        if (frame.next < pending.size()) {
+            open(*pending[frame.next++]);
+            continue;
+        }
+        size_t count = pending.size() - frame.first;
+        uint32_t at = put_record(*frame.node, frame.kind, done.data() + done.size() - count, count);
+        if (is_type(frame.kind)) m_emitted_types.emplace(frame.node, at);
+        done.resize(done.size() - count);
+        pending.resize(frame.first);
+        stack.pop_back();
+        done.push_back(at);
+    }
+    return done.back();
+}
+
+} // namespace
+
+void write_snapshot(const Program& program, const std::string& path) {
+    Writer writer;
+    uint32_t root = writer.emit(program);
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = VERSION;
+    header.root = root;
+    header.node_words = writer.words.size();
+    header.string_bytes = writer.strings.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("snapshot error: could not create " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+    out.write(reinterpret_cast<const char*>(writer.words.data()), writer.words.size() * sizeof(uint32_t));
+    out.write(writer.strings.data(), writer.strings.size());
+    if (!out) {
+        throw std::runtime_error("snapshot error: could not write " + path);
+    }
+}
+
+} // namespace snapshot
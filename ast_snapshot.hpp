@@ -0,0 +1,119 @@
+#pragma once
+
+#include "ast.hpp"
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Binary AST snapshots
+//
+// A snapshot is a compact, position-independent image of a `Program` that can
+// be written once after parsing and later mapped back with `mmap`. Loading a
+// snapshot checks every record once, in a single pass over the words, and
+// builds nothing: the views below then read the mapped words directly.
+//
+// Layout (all integers little-endian, records 4-byte aligned):
+//
+//   SnapshotHeader
+//   uint32_t words[node_words]     node records, children before parents
+//   char     strings[string_bytes] interned strings, each NUL-terminated
+//
+// Every record starts with a header word `kind | op << 8`, followed by:
+//   - one word per string field   (byte offset into the string pool)
+//   - one word per child field    (distance in words back to the child record)
+//   - two words for a Num value   (low word first)
+//   - for each list field, a count word followed by one child word per element
+namespace snapshot {
+
+enum class Kind : uint8_t {
+    IntType, StructType, FnType, PtrType, ArrayType, NilType,
+    Decl,
+    Id, Deref, ArrayAccess, FieldAccess,
+    Val, Num, NilExp, Select, UnOp, BinOp, NewSingle, NewArray, CallExp,
+    FunCall,
+    Assign, CallStmt, If, While, Break, Continue, Return,
+    FunctionDef, StructDef, Program,
+};
+
+struct SnapshotHeader {
+    char magic[8];            // "CFLATAST"
+    uint32_t version;
+    uint32_t root;            // word index of the Program record
+    uint64_t node_words;
+    uint64_t string_bytes;
+};
+
+class ListView;
+
+// A read-only view of one node record inside a snapshot.
+class NodeView {
+public:
+    NodeView(const uint32_t* record, const char* strings) : m_record(record), m_strings(strings) {}
+
+    Kind kind() const { return static_cast<Kind>(m_record[0] & 0xff); }
+    UnaryOp unary_op() const { return static_cast<UnaryOp>(m_record[0] >> 8); }
+    BinaryOp binary_op() const { return static_cast<BinaryOp>(m_record[0] >> 8); }
+
+    // The i-th string field: a type/decl/function/struct name, an Id, or a field name.
+    std::string_view str(size_t i = 0) const;
+    // The i-th fixed child, in the order the fields appear in ast.hpp.
+    NodeView child(size_t i) const;
+    // The i-th list field, in the order the fields appear in ast.hpp.
+    ListView list(size_t i) const;
+    // The value of a Num node.
+    long long num() const;
+
+    // Prints exactly what the corresponding ast.hpp node would print.
+    void print(std::ostream& os) const;
+
+private:
+    const uint32_t* m_record;
+    const char* m_strings;
+};
+
+// A read-only view of a list field (e.g. `FunctionDef::stmts`).
+class ListView {
+public:
+    ListView(const uint32_t* count, const uint32_t* owner, const char* strings)
+    : m_count(count), m_owner(owner), m_strings(strings) {}
+
+    size_t size() const { return *m_count; }
+    NodeView operator[](size_t i) const { return NodeView(m_owner - m_count[1 + i], m_strings); }
+
+private:
+    friend class NodeView;
+    const uint32_t* m_count;  // the count word; elements follow it
+    const uint32_t* m_owner;  // the record the list belongs to
+    const char* m_strings;
+};
+
+// A snapshot file mapped into memory. The mapping lives as long as the object.
+class Snapshot {
+public:
+    // Maps the snapshot at `path`; throws std::runtime_error if it is missing
+    // or malformed, including any offset or count that points outside it.
+    explicit Snapshot(const std::string& path);
+    ~Snapshot();
+
+    Snapshot(const Snapshot&) = delete;
+    Snapshot& operator=(const Snapshot&) = delete;
+
+    // The Program record.
+    NodeView root() const;
+    size_t size_bytes() const { return m_size; }
+
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+// Counts the nodes of the tree under `root`. Shared type records count once
+// per reference, matching the node count of the parsed Program.
+size_t count_nodes(const NodeView& root);
+
+// Serializes `program` to `path`; throws std::runtime_error on I/O failure or
+// if the records or the string pool outgrow their 32-bit offsets.
+void write_snapshot(const Program& program, const std::string& path);
+
+} // namespace snapshot
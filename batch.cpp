@@ -0,0 +1,187 @@
+#include "batch.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// One worker's share of the indices. The owner pops from the back and
+// thieves take from the front, so they only meet on the last item.
+struct WorkQueue {
+    std::mutex mutex;
+    std::deque<size_t> items;
+
+    bool pop_back(size_t& index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        index = items.back();
+        items.pop_back();
+        return true;
+    }
+
+    bool steal(size_t& index) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        index = items.front();
+        items.pop_front();
+        return true;
+    }
+};
+
+} // namespace
+
+void run_batch(size_t count, size_t threads, const std::function<void(size_t index, size_t worker)>& job) {
+    if (threads == 0) threads = 1;
+    if (threads > count) threads = count;
+    if (count == 0) return;
+
+    std::exception_ptr failure;
+    std::mutex failure_mutex;
+    auto run = [&](size_t index, size_t worker) {
+        try {
+            job(index, worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure) failure = std::current_exception();
+        }
+    };
+
+    // A single worker needs no queues and no threads.
+    if (threads == 1) {
+        for (size_t i = 0; i < count; ++i) run(i, 0);
+        if (failure) std::rethrow_exception(failure);
+        return;
+    }
+
+    // Contiguous shares, reversed so each owner works through its own share
+    // in input order; that keeps the ordered output flowing.
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (size_t w = 0; w < threads; ++w) {
+        queues.push_back(std::make_unique<WorkQueue>());
+        size_t begin = count * w / threads;
+        size_t end = count * (w + 1) / threads;
+        for (size_t i = end; i > begin; --i) queues[w]->items.push_back(i - 1);
+    }
+
+    auto worker_loop = [&](size_t worker) {
+        size_t index;
+        for (;;) {
+            if (queues[worker]->pop_back(index)) {
+                run(index, worker);
+                continue;
+            }
+            bool stole = false;
+            for (size_t k = 1; k < threads && !stole; ++k) {
+                stole = queues[(worker + k) % threads]->steal(index);
+            }
+            if (!stole) return;
+            run(index, worker);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (size_t w = 1; w < threads; ++w) pool.emplace_back(worker_loop, w);
+    worker_loop(0);
+    for (std::thread& thread : pool) thread.join();
+    if (failure) std::rethrow_exception(failure);
+}
+
+size_t default_batch_threads() {
+    unsigned n = std::thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+bool parse_jobs(const std::string& arg, size_t& jobs) {
+    if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos) return false;
+    jobs = std::strtoul(arg.c_str(), nullptr, 10);
+    return jobs != 0;
+}
+
+std::vector<std::string> read_file_list(const std::string& path) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (path != "-") {
+        file.open(path);
+        if (!file) throw std::runtime_error("Could not open file list: " + path);
+        in = &file;
+    }
+    std::vector<std::string> paths;
+    std::string line;
+    while (std::getline(*in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) paths.push_back(line);
+    }
+    return paths;
+}
+
+std::string batch_output_path(const std::string& dir, const std::string& input, const std::string& suffix) {
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    if (dir.empty() || dir.back() == '/') return dir + name + suffix;
+    return dir + "/" + name + suffix;
+}
+
+int run_batch_files(const std::vector<std::string>& paths, size_t threads, const std::string& out_dir,
+                    const std::string& suffix, std::ostream& out, std::ostream& err, const BatchProcess& process) {
+    // Two inputs with the same file name would write the same output file.
+    if (!out_dir.empty()) {
+        std::set<std::string> names;
+        for (const std::string& path : paths) {
+            if (!names.insert(batch_output_path(out_dir, path, suffix)).second) {
+                err << "Two inputs would both write " << batch_output_path(out_dir, path, suffix) << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    OrderedOutput output(out, err, out_dir.empty() && paths.size() > 1);
+    std::atomic<bool> failed(false);
+    run_batch(paths.size(), threads == 0 ? default_batch_threads() : threads, [&](size_t index, size_t worker) {
+        const std::string& path = paths[index];
+        std::ostringstream file_out, file_err;
+        bool ok = process(path, worker, file_out, file_err);
+        if (ok && !out_dir.empty()) {
+            std::string out_path = batch_output_path(out_dir, path, suffix);
+            std::ofstream file(out_path, std::ios::binary);
+            file << file_out.str();
+            if (!file) {
+                file_err << "Could not write file: " << out_path << std::endl;
+                ok = false;
+            }
+            file_out.str("");
+        }
+        if (!ok) failed = true;
+        output.complete(index, path, file_out.str(), file_err.str());
+    });
+    return failed ? 1 : 0;
+}
+
+void OrderedOutput::complete(size_t index, const std::string& path, std::string out, std::string err) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (index != m_next) {
+        m_pending.emplace(index, Result{path, std::move(out), std::move(err)});
+        return;
+    }
+    write(Result{path, std::move(out), std::move(err)});
+    ++m_next;
+    for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_next; it = m_pending.erase(it)) {
+        write(it->second);
+        ++m_next;
+    }
+    m_out.flush();
+}
+
+void OrderedOutput::write(const Result& result) {
+    if (m_headers) m_out << "==> " << result.path << " <==\n";
+    m_out << result.out;
+    m_err << result.err;
+}
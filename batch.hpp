@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Batch mode for the drivers: many input files in one process.
+//
+// run_batch() spreads the files over a pool of threads. Each worker starts
+// with a contiguous share of the indices in its own deque, takes work from
+// the back of it, and when it runs dry steals from the front of another
+// worker's deque, so a few large files don't leave the other threads idle.
+// All the work is known up front, so a worker is done once every deque is
+// empty.
+//
+// The job gets the index of the file and the worker running it, so callers
+// can keep per-worker state (a LexContext, say) in a vector indexed by worker.
+// If a job throws, the remaining jobs still run and the first exception is
+// rethrown once the workers have joined.
+void run_batch(size_t count, size_t threads, const std::function<void(size_t index, size_t worker)>& job);
+
+// The number of threads to use when none is given: one per hardware thread.
+size_t default_batch_threads();
+
+// Parses the argument of --jobs; false unless it is a positive number.
+bool parse_jobs(const std::string& arg, size_t& jobs);
+
+// Reads a list of paths, one per line; blank lines are skipped. "-" reads the
+// list from standard input. Throws std::runtime_error if the list can't be
+// opened.
+std::vector<std::string> read_file_list(const std::string& path);
+
+// Where a batch writes the result for `input` when given an output directory:
+// the input's file name plus `suffix`, inside `dir`.
+std::string batch_output_path(const std::string& dir, const std::string& input, const std::string& suffix);
+
+// Runs `process` over `paths` on `threads` workers (0 for the default) and
+// writes the results. With an `out_dir`, each file's output goes to
+// batch_output_path(out_dir, path, suffix); otherwise it all goes to `out` in
+// input order, with headers when there's more than one file. Diagnostics go
+// to `err` in input order either way. `process` returns false if its file
+// failed; the result is the exit status for the driver.
+using BatchProcess = std::function<bool(const std::string& path, size_t worker, std::ostream& out, std::ostream& err)>;
+int run_batch_files(const std::vector<std::string>& paths, size_t threads, const std::string& out_dir,
+                    const std::string& suffix, std::ostream& out, std::ostream& err, const BatchProcess& process);
+
+// Collects per-file output from the workers and writes it in input order.
+//
+// Results that finish early are held until everything before them has been
+// written, so the combined stream reads the same as running the files one by
+// one. With `headers`, each file's output is preceded by "==> path <==".
+class OrderedOutput {
+public:
+    OrderedOutput(std::ostream& out, std::ostream& err, bool headers) : m_out(out), m_err(err), m_headers(headers) {}
+
+    void complete(size_t index, const std::string& path, std::string out, std::string err);
+
+private:
+    struct Result {
+        std::string path;
+        std::string out;
+        std::string err;
+    };
+    std::ostream& m_out;
+    std::ostream& m_err;
+    bool m_headers;
+    std::mutex m_mutex;
+    size_t m_next = 0;
+    std::map<size_t, Result> m_pending;
+
+    void write(const Result& result);
+};
@@ -0,0 +1,374 @@
+// Throughput benchmarks for the lexer and parser.
+//
+// Usage: benchmark [-n <min-repetitions>] [--json <path>] [<input>...]
+//
+// Inputs ending in `.tk` are lexer output and go through tokenize_input and
+// the parser; anything else is Cflat source and goes through lex() with
+// each engine, a reused LexContext (also with its bracket index), lex_padded,
+// munch_token, the lex_lazily coroutine, the parser and the AST printer. The
+// parser runs over each token
+// source: a vector, a TokenBuffer, a mapped token file, lex_lazily
+// (lexing included, next to lex() plus the vector), and for source files
+// read from disk a Pipeline (next to reading, lexing and parsing in turn).
+// For comparison, the syntax checker runs over the first two, and the
+// parser with deferred function bodies over the vector. A synthetic program
+// of a few megabytes is always added so the numbers aren't dominated by
+// timer noise.
+//
+// For each benchmark this reports the median and p99 time per run, MB/s at
+// the median, and heap allocations per run. `--json` writes the same results
+// as a JSON array so runs can be compared across commits.
+#include "generator.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "pipeline.hpp"
+#include "syntax_check.hpp"
+#include "token_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// --- Allocation counting ---
+
+static std::atomic<size_t> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+// GCC sees free() paired with operator new once these are inlined into
+// library code, not knowing that operator new is the malloc() above.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+#pragma GCC diagnostic pop
+
+// --- Measurement ---
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    std::string benchmark;
+    std::string input;
+    size_t bytes;
+    size_t reps;
+    double median_ms;
+    double p99_ms;
+    size_t allocations;  // per run
+};
+
+// Runs `f` at least `min_reps` times, and more for fast inputs, up to about
+// a fifth of a second of samples.
+template <typename F>
+static Result measure(const std::string& benchmark, const std::string& input, size_t bytes, size_t min_reps, F&& f) {
+    f();  // warm up
+
+    std::vector<double> times;
+    size_t allocations = 0;
+    double spent_ms = 0;
+    while (times.size() < min_reps || (spent_ms < 200 && times.size() < 10000)) {
+        size_t allocs_before = g_allocations.load(std::memory_order_relaxed);
+        auto start = Clock::now();
+        f();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        allocations = g_allocations.load(std::memory_order_relaxed) - allocs_before;
+        times.push_back(ms);
+        spent_ms += ms;
+    }
+    std::sort(times.begin(), times.end());
+    size_t p99 = std::min(times.size() - 1, static_cast<size_t>(std::ceil(times.size() * 0.99)) - 1);
+    return {benchmark, input, bytes, times.size(), times[times.size() / 2], times[p99], allocations};
+}
+
+// Discards everything written to it, so printing measures formatting only.
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// --- Inputs ---
+
+// A valid program of roughly `target_bytes` bytes from the generator, with a
+// fixed seed so runs on different commits see the same input.
+static std::string synthetic_program(size_t target_bytes) {
+    GeneratorOptions options;
+    options.target_bytes = target_bytes;
+    std::ostringstream out;
+    generate_program(options, out);
+    return out.str();
+}
+
+static bool read_file(const std::string& path, std::string& contents) {
+    std::ifstream file(path);
+    if (!file) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    contents = buffer.str();
+    return true;
+}
+
+static bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// --- Benchmarks ---
+
+// Parses from `source`, made fresh for each run.
+template <typename MakeSource>
+static Result bench_parser(const std::string& benchmark, const std::string& name, size_t bytes, size_t reps,
+                           MakeSource&& make_source) {
+    return measure(benchmark, name, bytes, reps, [&] {
+        try {
+            BasicParser(make_source()).parse();
+        } catch (const std::runtime_error&) {
+            // Inputs with errors still measure the work up to the error.
+        }
+    });
+}
+
+// Checks the syntax from `source` without building the AST, like bench_parser.
+template <typename MakeSource>
+static Result bench_checker(const std::string& benchmark, const std::string& name, size_t bytes, size_t reps,
+                            MakeSource&& make_source) {
+    return measure(benchmark, name, bytes, reps, [&] {
+        try {
+            BasicSyntaxChecker(make_source()).check();
+        } catch (const std::runtime_error&) {
+        }
+    });
+}
+
+// Parses `tokens`, which point into [first, last), from each kind of token
+// source that holds them all: the vector (copied per run, as Parser takes
+// it), a TokenBuffer, and a mapped token file, parses only the signatures
+// from the vector, and checks them from the first two. Then prints the AST.
+static void bench_parse_and_print(const std::string& name, const char* first, const char* last,
+                                  const std::vector<Token>& tokens, size_t reps, std::vector<Result>& results) {
+    size_t bytes = static_cast<size_t>(last - first);
+    results.push_back(bench_parser("parse", name, bytes, reps, [&] { return VectorSource(tokens); }));
+
+    TokenBuffer buffer(tokens);
+    results.push_back(bench_parser("parse_soa", name, bytes, reps, [&] { return SoaSource(buffer); }));
+    results.push_back(measure("parse_deferred", name, bytes, reps, [&] {
+        try {
+            Parser parser(tokens);
+            parser.defer_function_bodies();
+            parser.parse();
+        } catch (const std::runtime_error&) {
+        }
+    }));
+    results.push_back(bench_checker("check", name, bytes, reps, [&] { return VectorSource(tokens); }));
+    results.push_back(bench_checker("check_soa", name, bytes, reps, [&] { return SoaSource(buffer); }));
+
+    char tokens_path[] = "/tmp/cflat-bench-XXXXXX";
+    int fd = ::mkstemp(tokens_path);
+    if (fd >= 0) {
+        ::close(fd);
+        token_file::write_token_file(tokens_path, first, last, tokens);
+        token_file::TokenFile file(tokens_path);
+        ::unlink(tokens_path);
+        results.push_back(bench_parser("parse_mapped", name, bytes, reps, [&] { return MappedSource(file); }));
+    }
+
+    std::unique_ptr<Program> program;
+    try {
+        program = Parser(tokens).parse();
+    } catch (const std::runtime_error&) {
+        return;
+    }
+    NullBuffer null_buffer;
+    std::ostream null_stream(&null_buffer);
+    results.push_back(measure("print", name, bytes, reps, [&] {
+        program->print(null_stream);
+    }));
+}
+
+static void bench_source(const std::string& name, const std::string& source, size_t reps, std::vector<Result>& results) {
+    const char* first = source.data();
+    const char* last = first + source.size();
+
+    results.push_back(measure("lex", name, source.size(), reps, [&] {
+        lex(first, last);
+    }));
+
+    results.push_back(measure("lex_table", name, source.size(), reps, [&] {
+        lex(first, last, LexEngine::Table);
+    }));
+
+    results.push_back(measure("lex_structural", name, source.size(), reps, [&] {
+        lex(first, last, LexEngine::Structural);
+    }));
+
+    LexContext context;
+    results.push_back(measure("lex_context", name, source.size(), reps, [&] {
+        context.lex(first, last);
+    }));
+
+    LexContext indexing;
+    indexing.index_brackets();
+    results.push_back(measure("lex_brackets", name, source.size(), reps, [&] {
+        indexing.lex(first, last);
+    }));
+
+    PaddedSource padded(source);
+    results.push_back(measure("lex_padded", name, source.size(), reps, [&] {
+        lex_padded(padded.begin(), padded.end());
+    }));
+
+    std::vector<Token> tokens = lex(first, last);
+    results.push_back(measure("munch_token", name, source.size(), reps, [&] {
+        for (const Token& token : tokens) {
+            volatile TokenType type = munch_token(token.first, last).token_type;
+            (void)type;
+        }
+    }));
+
+    results.push_back(measure("lex_lazily", name, source.size(), reps, [&] {
+        Generator<Token> lazy = lex_lazily(first, last);
+        while (lazy.next()) {
+            volatile TokenType type = lazy.value().token_type;
+            (void)type;
+        }
+    }));
+
+    bench_parse_and_print(name, first, last, tokens, reps, results);
+
+    results.push_back(bench_parser("lex_parse", name, source.size(), reps, [&] {
+        return VectorSource(lex(first, last));
+    }));
+
+    results.push_back(bench_parser("lazy_lex_parse", name, source.size(), reps, [&] {
+        return LazyLexSource(lex_lazily(first, last));
+    }));
+}
+
+// End to end from the file, so reading is part of the time: the stages in
+// sequence, then overlapped on the Pipeline's threads.
+static void bench_file(const std::string& path, size_t bytes, size_t reps, std::vector<Result>& results) {
+    std::string contents;
+    results.push_back(bench_parser("read_lex_parse", path, bytes, reps, [&] {
+        read_file(path, contents);
+        return VectorSource(lex(contents.data(), contents.data() + contents.size()));
+    }));
+    std::unique_ptr<Pipeline> pipeline;
+    results.push_back(bench_parser("pipeline", path, bytes, reps, [&] {
+        pipeline = std::make_unique<Pipeline>(path);
+        return FeedSource(*pipeline);
+    }));
+}
+
+static void bench_tokens(const std::string& name, const std::string& contents, size_t reps, std::vector<Result>& results) {
+    std::string line = contents.substr(0, contents.find('\n'));
+    results.push_back(measure("tokenize", name, line.size(), reps, [&] {
+        tokenize_input(line);
+    }));
+    bench_parse_and_print(name, line.data(), line.data() + line.size(), tokenize_input(line), reps, results);
+}
+
+// --- Reporting ---
+
+static double mb_per_s(const Result& r) {
+    return r.median_ms > 0 ? r.bytes / 1e6 / (r.median_ms / 1000.0) : 0;
+}
+
+static void print_table(std::ostream& os, const std::vector<Result>& results) {
+    os << std::left << std::setw(16) << "benchmark" << std::setw(24) << "input"
+       << std::right << std::setw(12) << "bytes" << std::setw(8) << "reps"
+       << std::setw(12) << "median ms" << std::setw(12) << "p99 ms"
+       << std::setw(10) << "MB/s" << std::setw(10) << "allocs" << "\n";
+    os << std::fixed << std::setprecision(3);
+    for (const auto& r : results) {
+        os << std::left << std::setw(16) << r.benchmark << std::setw(24) << r.input
+           << std::right << std::setw(12) << r.bytes << std::setw(8) << r.reps
+           << std::setw(12) << r.median_ms << std::setw(12) << r.p99_ms
+           << std::setprecision(1) << std::setw(10) << mb_per_s(r) << std::setprecision(3)
+           << std::setw(10) << r.allocations << "\n";
+    }
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+static void print_json(std::ostream& os, const std::vector<Result>& results) {
+    os << "[\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        os << "  {\"benchmark\": \"" << r.benchmark << "\", \"input\": \"" << json_escape(r.input)
+           << "\", \"bytes\": " << r.bytes << ", \"reps\": " << r.reps
+           << ", \"median_ms\": " << r.median_ms << ", \"p99_ms\": " << r.p99_ms
+           << ", \"mb_per_s\": " << mb_per_s(r) << ", \"allocations\": " << r.allocations << "}";
+        os << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t reps = 10;
+    std::string json_path;
+    std::vector<std::string> inputs;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            reps = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            inputs.push_back(arg);
+        }
+    }
+
+    std::vector<Result> results;
+    for (const auto& path : inputs) {
+        std::string contents;
+        if (!read_file(path, contents)) {
+            std::cerr << "Could not open file: " << path << std::endl;
+            return 1;
+        }
+        if (ends_with(path, ".tk")) {
+            bench_tokens(path, contents, reps, results);
+        } else {
+            bench_source(path, contents, reps, results);
+            bench_file(path, contents.size(), reps, results);
+        }
+    }
+    bench_source("synthetic-4MB", synthetic_program(4 << 20), reps, results);
+
+    print_table(std::cout, results);
+    if (!json_path.empty()) {
+        std::ofstream json(json_path);
+        if (!json) {
+            std::cerr << "Could not create file: " << json_path << std::endl;
+            return 1;
+        }
+        print_json(json, results);
+    }
+    return 0;
+}
@@ -0,0 +1,104 @@
+// Compares loading a program from a binary snapshot with re-parsing it.
+//
+// Usage: bench_snapshot [-n <repetitions>] <tokens-file>...
+//
+// Each input is a lexer output file (like test.tk). For every input this
+// reports the median time to tokenize and parse it, to map its snapshot, and
+// to map the snapshot and walk every node in it. Snapshots are written to
+// temporary files under /tmp.
+#include "parser.hpp"
+#include "ast_snapshot.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+static double median_ms(int reps, F&& f) {
+    std::vector<double> times;
+    for (int i = 0; i < reps; ++i) {
+        auto start = Clock::now();
+        f();
+        times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    int reps = 5;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-n" && i + 1 < argc) {
+            reps = std::max(1, std::stoi(argv[++i]));
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) {
+        std::cerr << "Usage: bench_snapshot [-n <repetitions>] <tokens-file>..." << std::endl;
+        return 1;
+    }
+
+    for (const auto& path : files) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Could not open file: " << path << std::endl;
+            return 1;
+        }
+        std::string line;
+        std::getline(file, line);
+
+        std::unique_ptr<Program> program;
+        try {
+            program = Parser(tokenize_input(line)).parse();
+        } catch (const std::runtime_error& e) {
+            std::cerr << path << ": " << e.what() << std::endl;
+            continue;
+        }
+        char snap_path[] = "/tmp/cflat-snapshot-XXXXXX";
+        int fd = ::mkstemp(snap_path);
+        if (fd < 0) {
+            std::cerr << path << ": could not create a temporary snapshot file" << std::endl;
+            continue;
+        }
+        ::close(fd);
+        try {
+            snapshot::write_snapshot(*program, snap_path);
+        } catch (const std::runtime_error& e) {
+            ::unlink(snap_path);
+            std::cerr << path << ": " << e.what() << std::endl;
+            continue;
+        }
+        program.reset();
+
+        double parse_ms = median_ms(reps, [&] {
+            std::unique_ptr<Program> p = Parser(tokenize_input(line)).parse();
+        });
+        size_t snap_bytes = 0;
+        double load_ms = median_ms(reps, [&] {
+            snapshot::Snapshot snap(snap_path);
+            snap_bytes = snap.size_bytes();
+        });
+        size_t nodes = 0;
+        double walk_ms = median_ms(reps, [&] {
+            snapshot::Snapshot snap(snap_path);
+            nodes = snapshot::count_nodes(snap.root());
+        });
+        ::unlink(snap_path);
+
+        std::cout << path << ": " << line.size() << " bytes of tokens, "
+                  << nodes << " nodes, snapshot " << snap_bytes << " bytes\n"
+                  << "  tokenize+parse  " << parse_ms << " ms\n"
+                  << "  snapshot load   " << load_ms << " ms\n"
+                  << "  load+walk       " << walk_ms << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+// Measures how long it takes to free a parsed program whose body is one long
+// left-associative chain `a + a + ... + a`, as built by parse_exp3.
+//
+// Usage: bench_teardown [-n <terms>]   (default 1000000)
+#include "parser.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// fn main() -> int { return a + a + ... + a; }
+static std::vector<Token> chain_tokens(size_t terms) {
+    static const char main_name[] = "main";
+    static const char a_name[] = "a";
+    std::vector<Token> tokens = {
+        {TokenType::Fn, nullptr, nullptr},
+        {TokenType::Id, main_name, main_name + 4},
+        {TokenType::OpenParen, nullptr, nullptr},
+        {TokenType::CloseParen, nullptr, nullptr},
+        {TokenType::Arrow, nullptr, nullptr},
+        {TokenType::Int, nullptr, nullptr},
+        {TokenType::OpenBrace, nullptr, nullptr},
+        {TokenType::Return, nullptr, nullptr},
+    };
+    for (size_t i = 0; i < terms; ++i) {
+        if (i > 0) tokens.push_back({TokenType::Plus, nullptr, nullptr});
+        tokens.push_back({TokenType::Id, a_name, a_name + 1});
+    }
+    tokens.push_back({TokenType::Semicolon, nullptr, nullptr});
+    tokens.push_back({TokenType::CloseBrace, nullptr, nullptr});
+    return tokens;
+}
+
+int main(int argc, char* argv[]) {
+    size_t terms = 1000000;
+    if (argc == 3 && std::string(argv[1]) == "-n") {
+        terms = std::stoul(argv[2]);
+    } else if (argc != 1) {
+        std::cerr << "Usage: bench_teardown [-n <terms>]" << std::endl;
+        return 1;
+    }
+
+    auto start = Clock::now();
+    std::unique_ptr<Program> program = Parser(chain_tokens(terms)).parse();
+    auto parsed = Clock::now();
+    program.reset();
+    auto freed = Clock::now();
+
+    // Each term is a BinOp, a Val and an Id.
+    std::cout << terms << " terms, ~" << 3 * terms << " nodes\n"
+              << "  parse    " << std::chrono::duration<double, std::milli>(parsed - start).count() << " ms\n"
+              << "  teardown " << std::chrono::duration<double, std::milli>(freed - parsed).count() << " ms" << std::endl;
+    return 0;
+}
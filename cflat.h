@@ -0,0 +1,247 @@
+#ifndef CFLAT_H_
+#define CFLAT_H_
+
+// The C API of libcflat: the lexer and parser in-process, without the
+// drivers or their text formats.
+//
+// Everything is reached through opaque handles, and the enums below have
+// fixed values, so programs built against one version of this header keep
+// working with later builds of the library. CFLAT_API_VERSION only goes up
+// when something here changes incompatibly.
+//
+// No function throws or aborts on bad input: lexing can't fail (bad input
+// becomes CFLAT_TOKEN_ERROR tokens), and a parse error is reported through
+// the context. Running out of memory is reported by each function's result,
+// as described at the function. The library is C++, so a static link needs
+// the C++ runtime (link with g++, or add -lstdc++).
+//
+// A context is not thread-safe; use one per thread. Programs are
+// independent of the context once parsed, and of the source too unless they
+// record locations (cflat_context_record_locations).
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define CFLAT_API __attribute__((visibility("default")))
+#else
+#define CFLAT_API
+#endif
+
+#define CFLAT_API_VERSION 1
+
+// The CFLAT_API_VERSION the library was built with.
+CFLAT_API int cflat_api_version(void);
+
+// --- Tokens ---
+
+typedef enum cflat_token_type {
+    CFLAT_TOKEN_ERROR = 0,
+    CFLAT_TOKEN_NUM = 1,
+    CFLAT_TOKEN_ID = 2,
+    CFLAT_TOKEN_INT = 3,
+    CFLAT_TOKEN_STRUCT = 4,
+    CFLAT_TOKEN_NIL = 5,
+    CFLAT_TOKEN_BREAK = 6,
+    CFLAT_TOKEN_CONTINUE = 7,
+    CFLAT_TOKEN_RETURN = 8,
+    CFLAT_TOKEN_IF = 9,
+    CFLAT_TOKEN_ELSE = 10,
+    CFLAT_TOKEN_WHILE = 11,
+    CFLAT_TOKEN_NEW = 12,
+    CFLAT_TOKEN_LET = 13,
+    CFLAT_TOKEN_EXTERN = 14,
+    CFLAT_TOKEN_FN = 15,
+    CFLAT_TOKEN_AND = 16,
+    CFLAT_TOKEN_OR = 17,
+    CFLAT_TOKEN_NOT = 18,
+    CFLAT_TOKEN_COLON = 19,
+    CFLAT_TOKEN_SEMICOLON = 20,
+    CFLAT_TOKEN_COMMA = 21,
+    CFLAT_TOKEN_ARROW = 22,
+    CFLAT_TOKEN_AMPERSAND = 23,
+    CFLAT_TOKEN_PLUS = 24,
+    CFLAT_TOKEN_DASH = 25,
+    CFLAT_TOKEN_STAR = 26,
+    CFLAT_TOKEN_SLASH = 27,
+    CFLAT_TOKEN_EQUAL = 28,
+    CFLAT_TOKEN_NOT_EQ = 29,
+    CFLAT_TOKEN_LT = 30,
+    CFLAT_TOKEN_LTE = 31,
+    CFLAT_TOKEN_GT = 32,
+    CFLAT_TOKEN_GTE = 33,
+    CFLAT_TOKEN_DOT = 34,
+    CFLAT_TOKEN_GETS = 35,
+    CFLAT_TOKEN_OPEN_PAREN = 36,
+    CFLAT_TOKEN_CLOSE_PAREN = 37,
+    CFLAT_TOKEN_OPEN_BRACKET = 38,
+    CFLAT_TOKEN_CLOSE_BRACKET = 39,
+    CFLAT_TOKEN_OPEN_BRACE = 40,
+    CFLAT_TOKEN_CLOSE_BRACE = 41,
+    CFLAT_TOKEN_QUESTION_MARK = 42
+} cflat_token_type;
+
+// A token points into the source it was lexed from. `value` is the number of
+// a CFLAT_TOKEN_NUM, or -1 if it doesn't fit in an int64_t; 0 otherwise.
+typedef struct cflat_token {
+    int type;  // a cflat_token_type
+    const char* first;
+    const char* last;
+    int64_t value;
+} cflat_token;
+
+typedef enum cflat_engine {
+    CFLAT_ENGINE_DEFAULT = 0,
+    CFLAT_ENGINE_TABLE = 1,
+    CFLAT_ENGINE_STRUCTURAL = 2
+} cflat_engine;
+
+// The name the `lex` driver prints for a token type, e.g. "OpenParen", or
+// NULL for an unknown type.
+CFLAT_API const char* cflat_token_type_name(int type);
+
+// --- Contexts ---
+
+typedef struct cflat_context cflat_context;
+
+// NULL if out of memory.
+CFLAT_API cflat_context* cflat_context_create(void);
+CFLAT_API void cflat_context_destroy(cflat_context* context);
+
+// Makes cflat_parse_source on the context record where each node starts,
+// for cflat_node_location; off by default, and costs nothing while off. The
+// source must then outlive the programs parsed from it.
+CFLAT_API void cflat_context_record_locations(cflat_context* context, int enabled);
+
+// Lexes [source, source + size) and points `*tokens` at the result, which
+// stays valid until the next cflat_lex on the context. Returns the number of
+// tokens. The context keeps its token storage between calls. If out of
+// memory, sets `*tokens` to NULL and returns 0.
+CFLAT_API size_t cflat_lex(cflat_context* context, const char* source, size_t size, int engine,
+                           const cflat_token** tokens);
+
+// --- Programs ---
+
+typedef struct cflat_program cflat_program;
+
+// Parses `count` tokens, e.g. from cflat_lex. On a parse error returns NULL
+// and sets the context's error. The program doesn't point into the tokens or
+// their source.
+CFLAT_API cflat_program* cflat_parse(cflat_context* context, const cflat_token* tokens, size_t count);
+
+// Lexes and parses in one go.
+CFLAT_API cflat_program* cflat_parse_source(cflat_context* context, const char* source, size_t size);
+
+CFLAT_API void cflat_program_free(cflat_program* program);
+
+// The message of the last failed parse on the context, or NULL if the last
+// parse succeeded. Valid until the next call on the context.
+CFLAT_API const char* cflat_error_message(const cflat_context* context);
+
+// The index of the token the last parse error is about.
+CFLAT_API size_t cflat_error_token(const cflat_context* context);
+
+// --- The AST ---
+
+typedef struct cflat_node cflat_node;
+
+typedef enum cflat_node_kind {
+    CFLAT_NODE_UNKNOWN = 0,
+    CFLAT_NODE_PROGRAM = 1,
+    CFLAT_NODE_STRUCT_DEF = 2,
+    CFLAT_NODE_FUNCTION_DEF = 3,
+    CFLAT_NODE_DECL = 4,
+    CFLAT_NODE_INT_TYPE = 5,
+    CFLAT_NODE_STRUCT_TYPE = 6,
+    CFLAT_NODE_FN_TYPE = 7,
+    CFLAT_NODE_PTR_TYPE = 8,
+    CFLAT_NODE_ARRAY_TYPE = 9,
+    CFLAT_NODE_NIL_TYPE = 10,
+    CFLAT_NODE_ASSIGN = 11,
+    CFLAT_NODE_CALL_STMT = 12,
+    CFLAT_NODE_IF = 13,
+    CFLAT_NODE_WHILE = 14,
+    CFLAT_NODE_BREAK = 15,
+    CFLAT_NODE_CONTINUE = 16,
+    CFLAT_NODE_RETURN = 17,
+    CFLAT_NODE_ID = 18,
+    CFLAT_NODE_DEREF = 19,
+    CFLAT_NODE_ARRAY_ACCESS = 20,
+    CFLAT_NODE_FIELD_ACCESS = 21,
+    CFLAT_NODE_VAL = 22,
+    CFLAT_NODE_NUM = 23,
+    CFLAT_NODE_NIL = 24,
+    CFLAT_NODE_SELECT = 25,
+    CFLAT_NODE_UN_OP = 26,
+    CFLAT_NODE_BIN_OP = 27,
+    CFLAT_NODE_NEW_SINGLE = 28,
+    CFLAT_NODE_NEW_ARRAY = 29,
+    CFLAT_NODE_CALL_EXP = 30,
+    CFLAT_NODE_FUN_CALL = 31
+} cflat_node_kind;
+
+typedef enum cflat_op {
+    CFLAT_OP_NONE = 0,
+    CFLAT_OP_NEG = 1,
+    CFLAT_OP_NOT = 2,
+    CFLAT_OP_ADD = 3,
+    CFLAT_OP_SUB = 4,
+    CFLAT_OP_MUL = 5,
+    CFLAT_OP_DIV = 6,
+    CFLAT_OP_AND = 7,
+    CFLAT_OP_OR = 8,
+    CFLAT_OP_EQ = 9,
+    CFLAT_OP_NOT_EQ = 10,
+    CFLAT_OP_LT = 11,
+    CFLAT_OP_LTE = 12,
+    CFLAT_OP_GT = 13,
+    CFLAT_OP_GTE = 14
+} cflat_op;
+
+// The Program node. Nodes live as long as their program.
+CFLAT_API const cflat_node* cflat_program_root(const cflat_program* program);
+
+CFLAT_API int cflat_node_kind_of(const cflat_node* node);  // a cflat_node_kind
+
+// Sets `*line` and `*column` (1-based; columns count bytes) to where `node`
+// of `program` starts and returns 1. Returns 0 for types, which are shared,
+// and for programs not parsed by cflat_parse_source with locations recorded.
+// The line table is built by the first call on a program.
+CFLAT_API int cflat_node_location(const cflat_program* program, const cflat_node* node, size_t* line,
+                                  size_t* column);
+
+// The name of the AST class of a kind, e.g. "BinOp", or NULL for an unknown
+// kind.
+CFLAT_API const char* cflat_node_kind_name(int kind);
+
+// Writes up to `capacity` children of `node` to `children`, in the order
+// the printer visits them, and returns how many there are; call with a
+// capacity of 0 to size the array. Types are shared between nodes, so the
+// same type node can be the child of many nodes. Returns SIZE_MAX, writing
+// nothing, if out of memory.
+CFLAT_API size_t cflat_node_children(const cflat_node* node, const cflat_node** children, size_t capacity);
+
+// The name of a Decl, Id, StructType, StructDef or FunctionDef, or the
+// field of a FieldAccess; NULL for other nodes.
+CFLAT_API const char* cflat_node_name(const cflat_node* node);
+
+// The value of a Num; 0 for other nodes.
+CFLAT_API int64_t cflat_node_value(const cflat_node* node);
+
+// The operator of a UnOp or BinOp; CFLAT_OP_NONE for other nodes.
+CFLAT_API int cflat_node_op(const cflat_node* node);
+
+// Prints `node` the way the `parse` driver does, snprintf-style: writes at
+// most `size` bytes including the terminating NUL, and returns the length of
+// the whole text. Returns SIZE_MAX, with an empty buffer, if out of memory.
+CFLAT_API size_t cflat_node_print(const cflat_node* node, char* buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,264 @@
+#include "cflat.h"
+#include "ast.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "source_location.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <optional>
+#include <sstream>
+#include <typeindex>
+#include <unordered_map>
+
+// The C API over Token, LexContext, Parser and the AST. Handles are the C++
+// objects themselves, or thin wrappers around them, so nothing is copied on
+// the way out; every entry point catches what the C++ side can throw.
+
+// cflat_token is Token seen from C; the lexer's tokens are handed out as is.
+static_assert(sizeof(cflat_token) == sizeof(Token), "cflat_token must match Token");
+static_assert(offsetof(cflat_token, first) == offsetof(Token, first), "cflat_token must match Token");
+static_assert(offsetof(cflat_token, last) == offsetof(Token, last), "cflat_token must match Token");
+static_assert(offsetof(cflat_token, value) == offsetof(Token, value), "cflat_token must match Token");
+static_assert(static_cast<int>(TokenType::QuestionMark) == CFLAT_TOKEN_QUESTION_MARK, "token types must match");
+static_assert(static_cast<int>(UnaryOp::Not) + CFLAT_OP_NEG == CFLAT_OP_NOT, "unary ops must match");
+static_assert(static_cast<int>(BinaryOp::Gte) + CFLAT_OP_ADD == CFLAT_OP_GTE, "binary ops must match");
+
+struct cflat_context {
+    LexContext lexer;
+    std::string error;  // empty after a successful parse
+    size_t error_token = 0;
+    bool record_locations = false;
+};
+
+struct cflat_program {
+    std::unique_ptr<Program> program;
+    // Only kept when the context records locations: the tokens and the first
+    // token of each node, and the lines of the source they point into.
+    std::vector<Token> tokens;
+    NodeTokens node_tokens;
+    std::optional<LineIndex> lines;
+};
+
+namespace {
+
+const Node* node_of(const cflat_node* node) {
+    return reinterpret_cast<const Node*>(node);
+}
+
+const cflat_node* handle_of(const Node* node) {
+    return reinterpret_cast<const cflat_node*>(node);
+}
+
+const Token* tokens_of(const cflat_token* tokens) {
+    return reinterpret_cast<const Token*>(tokens);
+}
+
+LexEngine engine_of(int engine) {
+    switch (engine) {
+        case CFLAT_ENGINE_TABLE: return LexEngine::Table;
+        case CFLAT_ENGINE_STRUCTURAL: return LexEngine::Structural;
+        default: return LexEngine::Handwritten;
+    }
+}
+
+// Parses for cflat_parse and cflat_parse_source. Locations are recorded only
+// when the context asks for them and the source is known.
+cflat_program* parse_tokens(cflat_context* context, const cflat_token* tokens, size_t count,
+                            const char* source, size_t size) {
+    try {
+        context->error.clear();
+        context->error_token = 0;
+        auto result = std::make_unique<cflat_program>();
+        bool locate = source && context->record_locations;
+        std::vector<Token> input(tokens_of(tokens), tokens_of(tokens) + count);
+        if (locate) result->tokens = input;
+        Parser parser(std::move(input));
+        if (locate) parser.record_node_tokens(result->node_tokens);
+        result->program = parser.parse();
+        if (locate) result->lines.emplace(source, source + size);
+        return result.release();
+    } catch (const ParseError& e) {
+        context->error = e.what();
+        context->error_token = e.token;
+    } catch (const std::exception& e) {
+        context->error = e.what();
+    } catch (...) {
+        context->error = "unknown error";
+    }
+    return nullptr;
+}
+
+const char* const KIND_NAMES[] = {
+    nullptr, "Program", "StructDef", "FunctionDef", "Decl", "IntType", "StructType", "FnType", "PtrType",
+    "ArrayType", "NilType", "Assign", "CallStmt", "If", "While", "Break", "Continue", "Return", "Id", "Deref",
+    "ArrayAccess", "FieldAccess", "Val", "Num", "NilExp", "Select", "UnOp", "BinOp", "NewSingle", "NewArray",
+    "CallExp", "FunCall",
+};
+
+int kind_of(const Node& node) {
+    static const std::unordered_map<std::type_index, int> kinds = {
+        {typeid(Program), CFLAT_NODE_PROGRAM},         {typeid(StructDef), CFLAT_NODE_STRUCT_DEF},
+        {typeid(FunctionDef), CFLAT_NODE_FUNCTION_DEF}, {typeid(Decl), CFLAT_NODE_DECL},
+        {typeid(IntType), CFLAT_NODE_INT_TYPE},         {typeid(StructType), CFLAT_NODE_STRUCT_TYPE},
+        {typeid(FnType), CFLAT_NODE_FN_TYPE},           {typeid(PtrType), CFLAT_NODE_PTR_TYPE},
+        {typeid(ArrayType), CFLAT_NODE_ARRAY_TYPE},     {typeid(NilType), CFLAT_NODE_NIL_TYPE},
+        {typeid(Assign), CFLAT_NODE_ASSIGN},           {typeid(CallStmt), CFLAT_NODE_CALL_STMT},
+        {typeid(If), CFLAT_NODE_IF},                   {typeid(While), CFLAT_NODE_WHILE},
+        {typeid(Break), CFLAT_NODE_BREAK},             {typeid(Continue), CFLAT_NODE_CONTINUE},
+        {typeid(Return), CFLAT_NODE_RETURN},           {typeid(Id), CFLAT_NODE_ID},
+        {typeid(Deref), CFLAT_NODE_DEREF},             {typeid(ArrayAccess), CFLAT_NODE_ARRAY_ACCESS},
+        {typeid(FieldAccess), CFLAT_NODE_FIELD_ACCESS}, {typeid(Val), CFLAT_NODE_VAL},
+        {typeid(Num), CFLAT_NODE_NUM},                 {typeid(NilExp), CFLAT_NODE_NIL},
+        {typeid(Select), CFLAT_NODE_SELECT},           {typeid(UnOp), CFLAT_NODE_UN_OP},
+        {typeid(BinOp), CFLAT_NODE_BIN_OP},            {typeid(NewSingle), CFLAT_NODE_NEW_SINGLE},
+        {typeid(NewArray), CFLAT_NODE_NEW_ARRAY},       {typeid(CallExp), CFLAT_NODE_CALL_EXP},
+        {typeid(FunCall), CFLAT_NODE_FUN_CALL},
+    };
+    auto it = kinds.find(typeid(node));
+    return it == kinds.end() ? CFLAT_NODE_UNKNOWN : it->second;
+}
+
+} // namespace
+
+extern "C" {
+
+int cflat_api_version(void) {
+    return CFLAT_API_VERSION;
+}
+
+const char* cflat_token_type_name(int type) {
+    if (type < 0 || type > CFLAT_TOKEN_QUESTION_MARK) return nullptr;
+    return token_type_name(static_cast<TokenType>(type));
+}
+
+cflat_context* cflat_context_create(void) {
+    return new (std::nothrow) cflat_context();
+}
+
+void cflat_context_destroy(cflat_context* context) {
+    delete context;
+}
+
+void cflat_context_record_locations(cflat_context* context, int enabled) {
+    context->record_locations = enabled != 0;
+}
+
+size_t cflat_lex(cflat_context* context, const char* source, size_t size, int engine, const cflat_token** tokens) {
+    try {
+        const std::vector<Token>& result = context->lexer.lex(source, source + size, engine_of(engine));
+        *tokens = reinterpret_cast<const cflat_token*>(result.data());
+        return result.size();
+    } catch (...) {
+        *tokens = nullptr;
+        return 0;
+    }
+}
+
+cflat_program* cflat_parse(cflat_context* context, const cflat_token* tokens, size_t count) {
+    return parse_tokens(context, tokens, count, nullptr, 0);
+}
+
+cflat_program* cflat_parse_source(cflat_context* context, const char* source, size_t size) {
+    const cflat_token* tokens;
+    size_t count = cflat_lex(context, source, size, CFLAT_ENGINE_DEFAULT, &tokens);
+    if (!tokens) {
+        context->error = "out of memory";
+        return nullptr;
+    }
+    return parse_tokens(context, tokens, count, source, size);
+}
+
+void cflat_program_free(cflat_program* program) {
+    delete program;
+}
+
+const char* cflat_error_message(const cflat_context* context) {
+    return context->error.empty() ? nullptr : context->error.c_str();
+}
+
+size_t cflat_error_token(const cflat_context* context) {
+    return context->error_token;
+}
+
+const cflat_node* cflat_program_root(const cflat_program* program) {
+    return handle_of(program->program.get());
+}
+
+int cflat_node_location(const cflat_program* program, const cflat_node* node, size_t* line, size_t* column) {
+    if (!program->lines) return 0;
+    try {
+        std::optional<SourceLocation> where = locate(*node_of(node), program->node_tokens, program->tokens, *program->lines);
+        if (!where) return 0;
+        *line = where->line;
+        *column = where->column;
+        return 1;
+    } catch (...) {
+        return 0;
+    }
+}
+
+int cflat_node_kind_of(const cflat_node* node) {
+    return kind_of(*node_of(node));
+}
+
+const char* cflat_node_kind_name(int kind) {
+    if (kind < 0 || kind > CFLAT_NODE_FUN_CALL) return nullptr;
+    return KIND_NAMES[kind];
+}
+
+size_t cflat_node_children(const cflat_node* node, const cflat_node** children, size_t capacity) {
+    try {
+        std::vector<const Node*> found;
+        node_of(node)->children(found);
+        for (size_t i = 0; i < found.size() && i < capacity; ++i) children[i] = handle_of(found[i]);
+        return found.size();
+    } catch (...) {
+        return SIZE_MAX;
+    }
+}
+
+const char* cflat_node_name(const cflat_node* handle) {
+    const Node* node = node_of(handle);
+    if (auto decl = dynamic_cast<const Decl*>(node)) return decl->name.c_str();
+    if (auto id = dynamic_cast<const Id*>(node)) return id->name.c_str();
+    if (auto type = dynamic_cast<const StructType*>(node)) return type->name.c_str();
+    if (auto def = dynamic_cast<const StructDef*>(node)) return def->name.c_str();
+    if (auto def = dynamic_cast<const FunctionDef*>(node)) return def->name.c_str();
+    if (auto access = dynamic_cast<const FieldAccess*>(node)) return access->field.c_str();
+    return nullptr;
+}
+
+int64_t cflat_node_value(const cflat_node* node) {
+    auto num = dynamic_cast<const Num*>(node_of(node));
+    return num ? num->value : 0;
+}
+
+int cflat_node_op(const cflat_node* node) {
+    if (auto op = dynamic_cast<const UnOp*>(node_of(node))) return CFLAT_OP_NEG + static_cast<int>(op->op);
+    if (auto op = dynamic_cast<const BinOp*>(node_of(node))) return CFLAT_OP_ADD + static_cast<int>(op->op);
+    return CFLAT_OP_NONE;
+}
+
+size_t cflat_node_print(const cflat_node* node, char* buffer, size_t size) {
+    try {
+        std::ostringstream out;
+        // A stream swallows what its buffer throws unless asked not to.
+        out.exceptions(std::ios::badbit);
+        node_of(node)->print(out);
+        std::string text = out.str();
+        if (size > 0) {
+            size_t n = text.size() < size - 1 ? text.size() : size - 1;
+            std::memcpy(buffer, text.data(), n);
+            buffer[n] = '\0';
+        }
+        return text.size();
+    } catch (...) {
+        if (size > 0) buffer[0] = '\0';
+        return SIZE_MAX;
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,86 @@
+#include "compile_server.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Stands in for `lex` and `parse`: the output and exit status are the same,
+// but the work is done by a running cflatd.
+
+static void usage() {
+    std::cerr << "Usage: cflatc [--socket <path>] lex [--table | --structural] [--locations] <input-file>\n"
+              << "       cflatc [--socket <path>] parse [--fold] [--locations] <filename>\n"
+              << "       cflatc [--socket <path>] lexparse [--fold] [--locations] <input-file>" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    using namespace compile_server;
+
+    std::string socket_path = default_socket_path();
+    int i = 1;
+    if (i + 1 < argc && std::string(argv[i]) == "--socket") {
+        socket_path = argv[i + 1];
+        i += 2;
+    }
+    if (i >= argc) {
+        usage();
+        return 1;
+    }
+
+    Request request;
+    std::string command = argv[i++];
+    if (command == "lex") {
+        request.kind = RequestKind::Lex;
+    } else if (command == "parse") {
+        request.kind = RequestKind::Parse;
+    } else if (command == "lexparse") {
+        request.kind = RequestKind::LexParse;
+    } else {
+        usage();
+        return 1;
+    }
+    bool lexes = request.kind != RequestKind::Parse;
+    bool parses = request.kind != RequestKind::Lex;
+    for (; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--table" && request.kind == RequestKind::Lex) {
+            request.flags |= FLAG_TABLE;
+        } else if (arg == "--structural" && request.kind == RequestKind::Lex) {
+            request.flags |= FLAG_STRUCTURAL;
+        } else if (arg == "--fold" && parses) {
+            request.flags |= FLAG_FOLD;
+        } else if (arg == "--locations") {
+            request.flags |= FLAG_LOCATIONS;
+        } else if (request.path.empty()) {
+            request.path = arg;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (request.path.empty()) {
+        usage();
+        return 1;
+    }
+
+    std::ifstream file(request.path, std::ios::binary);
+    if (!file) {
+        // The messages of the drivers this stands in for.
+        if (lexes) std::cerr << "Could not open file: " << request.path << std::endl;
+        else std::cerr << "Error: Could not open file " << request.path << std::endl;
+        return 1;
+    }
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    request.source = buffer.str();
+
+    try {
+        Response response = send_request(socket_path, request);
+        std::cout << response.out << std::flush;
+        std::cerr << response.err << std::flush;
+        return response.status;
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
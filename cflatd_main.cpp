@@ -0,0 +1,29 @@
+#include "compile_server.hpp"
+#include <iostream>
+#include <string>
+
+static void usage() {
+    std::cerr << "Usage: cflatd [--socket <path>]" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket_path = compile_server::default_socket_path();
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    try {
+        std::cerr << "cflatd: listening on " << socket_path << std::endl;
+        compile_server::serve(socket_path);
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "compile_server.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// The client side of the compile server, and the framing both ends use.
+
+namespace compile_server {
+
+std::runtime_error socket_error(const std::string& what) {
+    return std::runtime_error("server error: " + what + ": " + std::strerror(errno));
+}
+
+size_t read_full(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(fd, p + done, size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw socket_error("read failed");
+        if (n == 0) break;
+        done += static_cast<size_t>(n);
+    }
+    return done;
+}
+
+void read_exact(int fd, void* data, size_t size) {
+    if (read_full(fd, data, size) != size) throw std::runtime_error("server error: connection closed mid-message");
+}
+
+void write_all(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw socket_error("write failed");
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+sockaddr_un socket_address(const std::string& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("server error: socket path too long: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+Socket::~Socket() {
+    if (fd >= 0) ::close(fd);
+}
+
+std::string default_socket_path() {
+    if (const char* path = std::getenv("CFLAT_SOCKET")) return path;
+    return "/tmp/cflatd-" + std::to_string(::getuid()) + ".sock";
+}
+
+Response send_request(const std::string& socket_path, const Request& request) {
+    if (request.path.size() > MAX_PATH_SIZE || request.source.size() > MAX_SOURCE_SIZE) {
+        throw std::runtime_error("server error: " + request.path + " is too large for the server");
+    }
+    sockaddr_un addr = socket_address(socket_path);
+    Socket server(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (server.fd < 0) throw socket_error("socket failed");
+    if (::connect(server.fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+        throw socket_error("could not connect to " + socket_path);
+    }
+
+    RequestHeader header{REQUEST_MAGIC, static_cast<uint32_t>(request.kind), request.flags,
+                         static_cast<uint32_t>(request.path.size()), request.source.size()};
+    write_all(server.fd, &header, sizeof header);
+    write_all(server.fd, request.path.data(), request.path.size());
+    write_all(server.fd, request.source.data(), request.source.size());
+
+    ResponseHeader reply;
+    read_exact(server.fd, &reply, sizeof reply);
+    if (reply.magic != RESPONSE_MAGIC) throw std::runtime_error("server error: malformed reply");
+    Response response;
+    response.status = reply.status;
+    response.out.resize(reply.out_size);
+    read_exact(server.fd, &response.out[0], reply.out_size);
+    response.err.resize(reply.err_size);
+    read_exact(server.fd, &response.err[0], reply.err_size);
+    return response;
+}
+
+} // namespace compile_server
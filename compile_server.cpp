@@ -0,0 +1,216 @@
+#include "compile_server.hpp"
+#include "lex_output.hpp"
+#include "lexer.hpp"
+#include "parse_output.hpp"
+#include "parser.hpp"
+#include "stats.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <semaphore>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace compile_server {
+
+namespace {
+
+using ConnectionSlots = std::counting_semaphore<MAX_CONNECTIONS>;
+
+// Everything a request needs that is worth keeping between requests.
+struct Workspace {
+    LexContext lexer;
+    std::string path;
+    std::string source;  // the input followed by LEX_PADDING NULs
+    size_t source_size = 0;
+};
+
+// Idle workspaces; a connection takes one for its lifetime.
+class WorkspacePool {
+public:
+    std::unique_ptr<Workspace> acquire() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_idle.empty()) return std::make_unique<Workspace>();
+        std::unique_ptr<Workspace> workspace = std::move(m_idle.back());
+        m_idle.pop_back();
+        return workspace;
+    }
+
+    void release(std::unique_ptr<Workspace> workspace) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_idle.push_back(std::move(workspace));
+    }
+
+private:
+    std::mutex m_mutex;
+    std::vector<std::unique_ptr<Workspace>> m_idle;
+};
+
+LexEngine engine_for(uint32_t flags) {
+    if (flags & FLAG_TABLE) return LexEngine::Table;
+    if (flags & FLAG_STRUCTURAL) return LexEngine::Structural;
+    return LexEngine::Handwritten;
+}
+
+// Runs one request against the input in `ws`, writing what the driver would.
+int handle(Workspace& ws, RequestKind kind, uint32_t flags, std::ostream& out, std::ostream& err) {
+    const char* first = ws.source.data();
+    const char* last = first + ws.source_size;
+    ParseOptions options;
+    options.fold = flags & FLAG_FOLD;
+    options.show_locations = flags & FLAG_LOCATIONS;
+    Stats stats;
+
+    switch (kind) {
+        case RequestKind::Lex: {
+            LexEngine engine = engine_for(flags);
+            const std::vector<Token>& tokens = engine == LexEngine::Handwritten ? ws.lexer.lex_padded(first, last)
+                                                                                : ws.lexer.lex(first, last, engine);
+            print_tokens(tokens, out);
+            if (flags & FLAG_LOCATIONS) report_error_tokens(ws.path, first, last, tokens, err);
+            return 0;
+        }
+        case RequestKind::Parse: {
+            // Like `parse`, only the first line is read.
+            std::string line(first, std::find(first, last, '\n'));
+            parse_and_print(tokenize_input(line), line.data(), line.data() + line.size(), ws.path,
+                            options, out, err, stats, false);
+            return 0;
+        }
+        case RequestKind::LexParse: {
+            parse_and_print(ws.lexer.lex_padded(first, last), first, last, ws.path, options, out, err, stats, false);
+            return 0;
+        }
+    }
+    err << "server error: unknown request kind " << static_cast<uint32_t>(kind) << std::endl;
+    return 1;
+}
+
+// Replies to a request with `message` on stderr and exit status 1.
+void reply_error(int fd, const std::string& message) {
+    std::string err_text = "server error: " + message + "\n";
+    ResponseHeader reply{RESPONSE_MAGIC, 1, 0, err_text.size()};
+    write_all(fd, &reply, sizeof reply);
+    write_all(fd, err_text.data(), err_text.size());
+}
+
+// Answers requests on `fd` until the client hangs up or breaks the protocol,
+// then gives back its slot in `slots`.
+void serve_connection(int fd, WorkspacePool& pool, ConnectionSlots& slots) {
+    Socket client(fd);
+    std::unique_ptr<Workspace> ws = pool.acquire();
+    try {
+        for (;;) {
+            RequestHeader header;
+            size_t got = read_full(fd, &header, sizeof header);
+            if (got == 0) break;
+            if (got != sizeof header || header.magic != REQUEST_MAGIC) break;
+            if (header.path_size > MAX_PATH_SIZE || header.source_size > MAX_SOURCE_SIZE) {
+                reply_error(fd, "request too large");
+                break;
+            }
+
+            try {
+                ws->path.resize(header.path_size);
+                ws->source_size = header.source_size;
+                ws->source.resize(header.source_size + LEX_PADDING);
+            } catch (const std::bad_alloc&) {
+                // The request is still unread, so the connection can't go on.
+                reply_error(fd, "out of memory");
+                break;
+            }
+            read_exact(fd, &ws->path[0], header.path_size);
+            read_exact(fd, &ws->source[0], header.source_size);
+            std::fill(ws->source.begin() + header.source_size, ws->source.end(), '\0');
+
+            std::string out_text, err_text;
+            int status;
+            try {
+                std::ostringstream out, err;
+                status = handle(*ws, static_cast<RequestKind>(header.kind), header.flags, out, err);
+                out_text = out.str();
+                err_text = err.str();
+            } catch (const std::exception& e) {
+                reply_error(fd, e.what());
+                continue;
+            }
+            ResponseHeader reply{RESPONSE_MAGIC, status, out_text.size(), err_text.size()};
+            write_all(fd, &reply, sizeof reply);
+            write_all(fd, out_text.data(), out_text.size());
+            write_all(fd, err_text.data(), err_text.size());
+        }
+    } catch (const std::exception&) {
+        // A broken connection, or one the server ran out of memory on, only
+        // ends that connection.
+    }
+    pool.release(std::move(ws));
+    slots.release();
+}
+
+// For the signal handlers, which may only touch plain data.
+char g_socket_path[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void remove_socket_and_exit(int) {
+    ::unlink(g_socket_path);
+    ::_exit(0);
+}
+
+} // namespace
+
+void serve(const std::string& socket_path) {
+    sockaddr_un addr = socket_address(socket_path);
+
+    // A socket file nobody answers on is left over from a server that died.
+    {
+        Socket probe(::socket(AF_UNIX, SOCK_STREAM, 0));
+        if (probe.fd >= 0 && ::connect(probe.fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) == 0) {
+            throw std::runtime_error("server error: a server is already listening on " + socket_path);
+        }
+    }
+    ::unlink(socket_path.c_str());
+
+    Socket listener(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (listener.fd < 0) throw socket_error("socket failed");
+    if (::bind(listener.fd, reinterpret_cast<sockaddr*>(&addr), sizeof addr) < 0) {
+        throw socket_error("could not bind " + socket_path);
+    }
+    if (::listen(listener.fd, SOMAXCONN) < 0) throw socket_error("listen failed");
+
+    std::memcpy(g_socket_path, addr.sun_path, sizeof g_socket_path);
+    std::signal(SIGINT, remove_socket_and_exit);
+    std::signal(SIGTERM, remove_socket_and_exit);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    WorkspacePool pool;
+    ConnectionSlots slots(MAX_CONNECTIONS);
+    for (;;) {
+        slots.acquire();
+        int fd = ::accept(listener.fd, nullptr, nullptr);
+        if (fd < 0) {
+            slots.release();
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            throw socket_error("accept failed");
+        }
+        try {
+            std::thread(serve_connection, fd, std::ref(pool), std::ref(slots)).detach();
+        } catch (const std::system_error&) {
+            // Out of threads: turn this client away rather than the server.
+            ::close(fd);
+            slots.release();
+        }
+    }
+}
+
+} // namespace compile_server
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <sys/un.h>
+
+// A long-running lex/parse server on a Unix domain socket.
+//
+// Starting `lex` or `parse` for every small file costs more than the work:
+// process startup, iostream setup and faulting in the binary. cflatd pays that
+// once and then serves requests; cflatc sends a file and prints the reply, with
+// the same output and exit status as the driver it stands in for.
+//
+// A connection carries any number of requests, answered in order. Each
+// connection is served on its own thread with a Workspace (a LexContext and
+// the request and reply buffers) taken from a shared pool, so a warm server
+// lexes and parses without reallocating its buffers. A request that fails,
+// even by running out of memory, gets an error reply with status 1.
+//
+// The wire format is native-endian and unversioned beyond the magic number:
+// both ends are built from this tree and run on the same machine.
+namespace compile_server {
+
+constexpr uint32_t REQUEST_MAGIC = 0x51464c43;   // "CLFQ"
+constexpr uint32_t RESPONSE_MAGIC = 0x52464c43;  // "CLFR"
+
+enum class RequestKind : uint32_t {
+    Lex = 1,       // source in, `lex` output back
+    Parse = 2,     // `lex` output in, `parse` output back
+    LexParse = 3,  // source in, parsed straight from the tokens
+};
+
+// Bits of RequestHeader::flags; the driver flags of the same names.
+enum RequestFlags : uint32_t {
+    FLAG_TABLE = 1,
+    FLAG_STRUCTURAL = 2,
+    FLAG_LOCATIONS = 4,
+    FLAG_FOLD = 8,
+};
+
+// The largest request the server reads. A larger one is answered with an
+// error and ends the connection; the client refuses to send it at all.
+constexpr uint32_t MAX_PATH_SIZE = 4096;
+constexpr uint64_t MAX_SOURCE_SIZE = uint64_t(64) << 20;
+
+// Connections served at once. Further clients wait in the listen backlog
+// until one of them hangs up.
+constexpr size_t MAX_CONNECTIONS = 64;
+
+// Followed by `path_size` bytes of path, used only in diagnostics, and
+// `source_size` bytes of input.
+struct RequestHeader {
+    uint32_t magic;
+    uint32_t kind;
+    uint32_t flags;
+    uint32_t path_size;
+    uint64_t source_size;
+};
+
+// Followed by `out_size` bytes for stdout and `err_size` bytes for stderr.
+struct ResponseHeader {
+    uint32_t magic;
+    int32_t status;  // the driver's exit status
+    uint64_t out_size;
+    uint64_t err_size;
+};
+
+struct Request {
+    RequestKind kind = RequestKind::Lex;
+    uint32_t flags = 0;
+    std::string path;
+    std::string source;
+};
+
+struct Response {
+    int status = 0;
+    std::string out;
+    std::string err;
+};
+
+// The socket used when none is given: $CFLAT_SOCKET, or a per-user path in /tmp.
+std::string default_socket_path();
+
+// --- Framing, shared by both ends (compile_client.cpp) ---
+
+// A std::runtime_error naming `what` and the current errno.
+std::runtime_error socket_error(const std::string& what);
+// Reads up to `size` bytes, stopping early only at end of stream; returns the
+// number read. Throws on a read error.
+size_t read_full(int fd, void* data, size_t size);
+// Reads exactly `size` bytes; throws if the stream ends first.
+void read_exact(int fd, void* data, size_t size);
+// Writes all of `data`; throws on error.
+void write_all(int fd, const void* data, size_t size);
+// The address of the socket at `path`; throws if the path is too long.
+sockaddr_un socket_address(const std::string& path);
+
+// Closes the descriptor when it goes out of scope.
+struct Socket {
+    int fd;
+    explicit Socket(int fd) : fd(fd) {}
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    ~Socket();
+};
+
+// Listens on `socket_path`, replacing a stale socket file, and serves until
+// the process is killed; SIGINT and SIGTERM remove the socket file first.
+// Throws std::runtime_error if the socket can't be set up.
+void serve(const std::string& socket_path);
+
+// Sends one request and waits for the reply; in compile_client.cpp, so the
+// client links without the lexer and parser.
+// Throws std::runtime_error if the server can't be reached or the connection
+// breaks.
+Response send_request(const std::string& socket_path, const Request& request);
+
+} // namespace compile_server
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+// A sequence computed on demand by a C++20 coroutine: the coroutine body
+// runs only when the next item is asked for, up to its next co_yield, so
+// nothing is produced ahead of the consumer and nothing is buffered.
+//
+//     Generator<int> count(int n) {
+//         for (int i = 0; i < n; ++i) co_yield i;
+//     }
+//
+//     Generator<int> numbers = count(3);
+//     while (numbers.next()) use(numbers.value());
+//
+// An exception thrown by the coroutine comes out of the next() that ran it.
+template <typename T>
+class Generator {
+public:
+    struct promise_type {
+        T current{};
+        std::exception_ptr error;
+
+        Generator get_return_object() { return Generator(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T value) noexcept {
+            current = std::move(value);
+            return {};
+        }
+        void return_void() noexcept {}
+        void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    Generator(Generator&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Generator& operator=(Generator&& other) noexcept {
+        if (this != &other) {
+            if (m_handle) m_handle.destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    ~Generator() {
+        if (m_handle) m_handle.destroy();
+    }
+
+    // Runs the coroutine to its next item. Returns false once it has
+    // finished; don't call again after that.
+    bool next() {
+        m_handle.resume();
+        if (m_handle.done()) {
+            if (m_handle.promise().error) std::rethrow_exception(m_handle.promise().error);
+            return false;
+        }
+        return true;
+    }
+
+    // The item the last successful next() produced.
+    const T& value() const { return m_handle.promise().current; }
+
+private:
+    using Handle = std::coroutine_handle<promise_type>;
+    explicit Generator(Handle handle) : m_handle(handle) {}
+
+    Handle m_handle;
+};
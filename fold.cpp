@@ -0,0 +1,153 @@
+#include "fold.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+using ExpSlots = std::vector<std::unique_ptr<Exp>*>;
+
+// Number of nodes in the expression tree at `exp`. Types are interned, not
+// part of the tree, so they aren't counted.
+static size_t count_nodes(const Exp& exp) {
+    size_t count = 0;
+    std::vector<const Node*> work{&exp};
+    while (!work.empty()) {
+        const Node* node = work.back();
+        work.pop_back();
+        if (dynamic_cast<const Type*>(node)) continue;
+        ++count;
+        node->children(work);
+    }
+    return count;
+}
+
+static const Num* as_num(const std::unique_ptr<Exp>& exp) {
+    return dynamic_cast<const Num*>(exp.get());
+}
+
+// Two's complement wraparound without signed overflow.
+static long long wrap(uint64_t bits) {
+    return static_cast<long long>(bits);
+}
+
+// Evaluates `l op r`; returns false if the result must stay unfolded.
+static bool eval(BinaryOp op, long long l, long long r, long long& result) {
+    uint64_t ul = static_cast<uint64_t>(l);
+    uint64_t ur = static_cast<uint64_t>(r);
+    switch (op) {
+        case BinaryOp::Add: result = wrap(ul + ur); return true;
+        case BinaryOp::Sub: result = wrap(ul - ur); return true;
+        case BinaryOp::Mul: result = wrap(ul * ur); return true;
+        case BinaryOp::Div:
+            if (r == 0) return false;
+            // The one quotient that doesn't fit wraps back to itself.
+            if (l == std::numeric_limits<long long>::min() && r == -1) {
+                result = l;
+            } else {
+                result = l / r;
+            }
+            return true;
+        case BinaryOp::And: result = (l != 0 && r != 0); return true;
+        case BinaryOp::Or: result = (l != 0 || r != 0); return true;
+        case BinaryOp::Eq: result = (l == r); return true;
+        case BinaryOp::NotEq: result = (l != r); return true;
+        case BinaryOp::Lt: result = (l < r); return true;
+        case BinaryOp::Lte: result = (l <= r); return true;
+        case BinaryOp::Gt: result = (l > r); return true;
+        case BinaryOp::Gte: result = (l >= r); return true;
+    }
+    return false;
+}
+
+// Folds the node in `slot`, whose children have already been folded.
+static size_t fold_node(std::unique_ptr<Exp>& slot) {
+    if (auto n = dynamic_cast<BinOp*>(slot.get())) {
+        const Num* l = as_num(n->left);
+        const Num* r = as_num(n->right);
+        long long result;
+        if (l && r && eval(n->op, l->value, r->value, result)) {
+            slot = std::make_unique<Num>(result);
+            return 2;
+        }
+    } else if (auto n = dynamic_cast<UnOp*>(slot.get())) {
+        if (const Num* e = as_num(n->exp)) {
+            long long result = n->op == UnaryOp::Neg ? wrap(0 - static_cast<uint64_t>(e->value)) : (e->value == 0);
+            slot = std::make_unique<Num>(result);
+            return 1;
+        }
+    } else if (auto n = dynamic_cast<Select*>(slot.get())) {
+        if (const Num* g = as_num(n->guard)) {
+            std::unique_ptr<Exp>& taken = g->value != 0 ? n->tt : n->ff;
+            std::unique_ptr<Exp>& dropped = g->value != 0 ? n->ff : n->tt;
+            size_t removed = 2 + count_nodes(*dropped);
+            std::unique_ptr<Exp> keep = std::move(taken);
+            slot = std::move(keep);
+            return removed;
+        }
+    }
+    return 0;
+}
+
+// Folds the expression in `root` bottom-up with an explicit stack, so long
+// operator chains don't recurse.
+static size_t fold_exp(std::unique_ptr<Exp>& root) {
+    struct Frame {
+        std::unique_ptr<Exp>* slot;
+        bool expanded;
+    };
+    size_t removed = 0;
+    std::vector<Frame> stack{{&root, false}};
+    ExpSlots children;
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        if (frame.expanded) {
+            stack.pop_back();
+            removed += fold_node(*frame.slot);
+            continue;
+        }
+        stack.back().expanded = true;
+        children.clear();
+        (*frame.slot)->exp_slots(children);
+        for (auto* child : children) stack.push_back({child, false});
+    }
+    return removed;
+}
+
+// Folds the expressions under a Place or FunCall.
+static size_t fold_children(Node& node) {
+    size_t removed = 0;
+    ExpSlots slots;
+    node.exp_slots(slots);
+    for (auto* slot : slots) removed += fold_exp(*slot);
+    return removed;
+}
+
+static size_t fold_stmts(std::vector<std::unique_ptr<Stmt>>& stmts) {
+    size_t removed = 0;
+    for (auto& stmt : stmts) {
+        if (auto s = dynamic_cast<Assign*>(stmt.get())) {
+            removed += fold_children(*s->place);
+            removed += fold_exp(s->exp);
+        } else if (auto s = dynamic_cast<CallStmt*>(stmt.get())) {
+            removed += fold_children(*s->fun_call);
+        } else if (auto s = dynamic_cast<If*>(stmt.get())) {
+            removed += fold_exp(s->guard);
+            removed += fold_stmts(s->tt);
+            removed += fold_stmts(s->ff);
+        } else if (auto s = dynamic_cast<While*>(stmt.get())) {
+            removed += fold_exp(s->guard);
+            removed += fold_stmts(s->body);
+        } else if (auto s = dynamic_cast<Return*>(stmt.get())) {
+            removed += fold_exp(s->exp);
+        }
+    }
+    return removed;
+}
+
+size_t fold_constants(Program& program) {
+    size_t removed = 0;
+    for (auto& function : program.functions) {
+        removed += fold_stmts(function->stmts());
+    }
+    return removed;
+}
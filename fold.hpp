@@ -0,0 +1,18 @@
+#pragma once
+
+#include "ast.hpp"
+#include <cstddef>
+
+// Constant folding
+//
+// Rewrites every BinOp, UnOp and Select whose operands are integer literals
+// into the literal it evaluates to, bottom-up, so nested constant subtrees
+// collapse completely. Arithmetic wraps around like i64 in two's complement;
+// a division by zero is left in place for the program to fail on at run
+// time. Comparisons and `and`/`or`/`not` produce 1 or 0, and a Select with
+// a constant guard is replaced by the branch it picks.
+//
+// Folded results may be negative, unlike the Num nodes the parser builds.
+//
+// Returns the number of nodes removed from the tree.
+size_t fold_constants(Program& program);
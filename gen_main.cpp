@@ -0,0 +1,69 @@
+#include "generator.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static void usage() {
+    std::cerr << "Usage: gen [--size <bytes>[K|M|G]] [--depth <n>] [--ident-len <n>]\n"
+              << "           [--errors <density>] [--seed <n>] [-o <output-file>]" << std::endl;
+}
+
+// Parses sizes like "512", "64K", "10M" or "1G".
+static bool parse_size(const std::string& text, size_t& bytes) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return false;
+    std::string suffix(end);
+    if (suffix == "K" || suffix == "k") value <<= 10;
+    else if (suffix == "M" || suffix == "m") value <<= 20;
+    else if (suffix == "G" || suffix == "g") value <<= 30;
+    else if (!suffix.empty()) return false;
+    bytes = static_cast<size_t>(value);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    GeneratorOptions options;
+    std::string output_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        std::string value = argv[++i];
+        if (arg == "--size") {
+            if (!parse_size(value, options.target_bytes)) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--depth") {
+            options.max_depth = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--ident-len") {
+            options.ident_length = std::max(1, std::atoi(value.c_str()));
+        } else if (arg == "--errors") {
+            options.error_density = std::atof(value.c_str());
+        } else if (arg == "--seed") {
+            options.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "-o") {
+            output_path = value;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (output_path.empty()) {
+        generate_program(options, std::cout);
+        return std::cout ? 0 : 1;
+    }
+    std::ofstream out(output_path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Could not create file: " << output_path << std::endl;
+        return 1;
+    }
+    generate_program(options, out);
+    return out ? 0 : 1;
+}
@@ -0,0 +1,401 @@
+#include "generator.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+const char* const KEYWORDS[] = {
+    "int", "struct", "nil", "break", "continue", "return", "if", "else",
+    "while", "new", "let", "extern", "fn", "and", "or", "not",
+};
+
+const char* const BINARY_OPS[] = {
+    "+", "-", "*", "/", "and", "or", "==", "!=", "<", "<=", ">", ">=",
+};
+
+// Characters that never start a token.
+const char ERROR_CHARS[] = "~@#$%^`|\\'\"";
+
+class Generator {
+public:
+    Generator(const GeneratorOptions& options, std::ostream& out)
+    : m_options(options), m_out(out), m_state(options.seed) {}
+
+    size_t run() {
+        while (m_written + m_buffer.size() < m_options.target_bytes) {
+            item();
+        }
+        flush();
+        return m_written;
+    }
+
+private:
+    const GeneratorOptions& m_options;
+    std::ostream& m_out;
+    uint64_t m_state;
+    std::string m_buffer;
+    size_t m_written = 0;
+    char m_last = '\0';  // last character already flushed
+    int m_indent = 0;
+
+    std::vector<std::string> m_structs;    // struct names declared so far
+    std::vector<std::string> m_callables;  // extern and function names so far
+    std::vector<std::string> m_locals;     // params and locals of the current function
+
+    // --- Randomness (splitmix64, so the output doesn't depend on the standard library) ---
+
+    uint64_t next() {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    size_t below(size_t n) { return static_cast<size_t>(next() % n); }
+    bool chance(double p) { return (next() >> 11) * (1.0 / 9007199254740992.0) < p; }
+
+    template <typename T, size_t N>
+    const T& pick(const T (&items)[N]) { return items[below(N)]; }
+
+    const std::string& pick(const std::vector<std::string>& items) { return items[below(items.size())]; }
+
+    // --- Output ---
+
+    void flush() {
+        if (!m_buffer.empty()) m_last = m_buffer.back();
+        m_out.write(m_buffer.data(), static_cast<std::streamsize>(m_buffer.size()));
+        m_written += m_buffer.size();
+        m_buffer.clear();
+    }
+
+    // Writes one token, separated from the previous one by a space unless
+    // punctuation makes it unnecessary.
+    void put(std::string_view token) {
+        if (m_options.error_density > 0 && chance(m_options.error_density)) {
+            if (!m_buffer.empty() && m_buffer.back() != '\n') m_buffer += ' ';
+            for (size_t n = 1 + below(3); n > 0; --n) m_buffer += ERROR_CHARS[below(sizeof ERROR_CHARS - 1)];
+            m_buffer += ' ';
+        }
+        if (needs_space(token)) m_buffer += ' ';
+        m_buffer += token;
+        if (m_buffer.size() >= (1 << 16)) flush();
+    }
+
+    bool needs_space(std::string_view token) const {
+        char prev = m_buffer.empty() ? m_last : m_buffer.back();
+        if (prev == '\0' || prev == '\n' || prev == ' ' || prev == '(' || prev == '[' || prev == '.') return false;
+        switch (token[0]) {
+            case ',': case ';': case ')': case ']': case '.': return false;
+            case '(': case '[': return !(std::isalnum(static_cast<unsigned char>(prev)) || prev == '_');
+            default: return true;
+        }
+    }
+
+    void newline() {
+        m_buffer += '\n';
+        m_buffer.append(4 * m_indent, ' ');
+    }
+
+    // --- Names ---
+
+    std::string fresh_ident() {
+        static const char first_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        static const char rest_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+        int base = std::max(1, m_options.ident_length);
+        size_t length = static_cast<size_t>(std::max(1, base / 2 + static_cast<int>(below(base + 1))));
+        for (;;) {
+            std::string name(1, first_chars[below(sizeof first_chars - 1)]);
+            while (name.size() < length) name += rest_chars[below(sizeof rest_chars - 1)];
+            if (std::none_of(std::begin(KEYWORDS), std::end(KEYWORDS), [&](const char* k) { return name == k; })) {
+                return name;
+            }
+        }
+    }
+
+    // Remembers `name` in a bounded pool so later items refer back to it.
+    static void remember(std::vector<std::string>& pool, const std::string& name) {
+        if (pool.size() < 256) {
+            pool.push_back(name);
+        } else {
+            pool[name.size() * 31 % pool.size()] = name;
+        }
+    }
+
+    std::string variable() {
+        return m_locals.empty() || chance(0.1) ? fresh_ident() : pick(m_locals);
+    }
+
+    std::string callable() {
+        return m_callables.empty() || chance(0.1) ? fresh_ident() : pick(m_callables);
+    }
+
+    // --- Top level ---
+
+    void item() {
+        size_t kind = below(10);
+        if (kind < 2) {
+            struct_def();
+        } else if (kind < 4) {
+            extern_def();
+        } else {
+            function();
+        }
+        newline();
+        newline();
+    }
+
+    // struct ::= `struct` id `{` LIST(decl) `}`
+    void struct_def() {
+        if (chance(0.3)) {
+            m_buffer += "// struct";
+            newline();
+        }
+        std::string name = fresh_ident();
+        remember(m_structs, name);
+        put("struct");
+        put(name);
+        put("{");
+        for (size_t i = 0, n = below(5); i < n; ++i) {
+            if (i > 0) put(",");
+            decl(fresh_ident());
+        }
+        put("}");
+    }
+
+    // extern ::= `extern` id `:` funtype `;`
+    void extern_def() {
+        std::string name = fresh_ident();
+        remember(m_callables, name);
+        put("extern");
+        put(name);
+        put(":");
+        funtype(1);
+        put(";");
+    }
+
+    // function ::= `fn` id `(` LIST(decl) `)` `->` type `{` let⋆ stmt⋆ `}`
+    void function() {
+        if (chance(0.3)) {
+            m_buffer += "/* function */";
+            newline();
+        }
+        std::string name = fresh_ident();
+        remember(m_callables, name);
+        m_locals.clear();
+
+        put("fn");
+        put(name);
+        put("(");
+        for (size_t i = 0, n = below(4); i < n; ++i) {
+            if (i > 0) put(",");
+            std::string param = fresh_ident();
+            m_locals.push_back(param);
+            decl(param);
+        }
+        put(")");
+        put("->");
+        type(1);
+        put("{");
+        ++m_indent;
+        for (size_t lets = below(3); lets > 0; --lets) {
+            newline();
+            put("let");
+            for (size_t i = 0, n = 1 + below(4); i < n; ++i) {
+                if (i > 0) put(",");
+                std::string local = fresh_ident();
+                m_locals.push_back(local);
+                decl(local);
+            }
+            put(";");
+        }
+        for (size_t n = 1 + below(8); n > 0; --n) {
+            newline();
+            stmt(1);
+        }
+        --m_indent;
+        newline();
+        put("}");
+    }
+
+    // decl ::= id `:` type
+    void decl(const std::string& name) {
+        put(name);
+        put(":");
+        type(1);
+    }
+
+    // --- Types ---
+
+    void type(int depth) {
+        size_t kind = depth >= m_options.max_depth ? below(2) : below(8);
+        switch (kind) {
+            case 0: case 2: case 3: put("int"); break;
+            case 1: case 4: put(m_structs.empty() ? fresh_ident() : pick(m_structs)); break;
+            case 5: put("&"); type(depth + 1); break;
+            case 6: put("["); type(depth + 1); put("]"); break;
+            default: funtype(depth + 1); break;
+        }
+    }
+
+    // funtype ::= `(` LIST(type) `)` `->` type
+    void funtype(int depth) {
+        put("(");
+        for (size_t i = 0, n = below(4); i < n; ++i) {
+            if (i > 0) put(",");
+            type(depth + 1);
+        }
+        put(")");
+        put("->");
+        type(depth + 1);
+    }
+
+    // --- Statements ---
+
+    void block(int depth) {
+        put("{");
+        ++m_indent;
+        for (size_t n = below(4); n > 0; --n) {
+            newline();
+            stmt(depth + 1);
+        }
+        --m_indent;
+        newline();
+        put("}");
+    }
+
+    void stmt(int depth) {
+        size_t kind = depth >= m_options.max_depth ? below(5) : below(9);
+        switch (kind) {
+            case 0: case 1: case 2:
+                place(depth);
+                put("=");
+                exp(depth);
+                put(";");
+                break;
+            case 3:
+                call(depth);
+                put(";");
+                break;
+            case 4:
+                put("return");
+                exp(depth);
+                put(";");
+                break;
+            case 5:
+                put("if");
+                exp(depth);
+                block(depth);
+                if (chance(0.5)) {
+                    put("else");
+                    block(depth);
+                }
+                break;
+            case 6:
+                put("while");
+                exp(depth);
+                block(depth);
+                break;
+            case 7:
+                put("break");
+                put(";");
+                break;
+            default:
+                put("continue");
+                put(";");
+                break;
+        }
+    }
+
+    // --- Expressions ---
+
+    // A place: id, or an array, field or deref access on a postfix expression.
+    void place(int depth) {
+        if (depth >= m_options.max_depth || chance(0.5)) {
+            put(variable());
+            return;
+        }
+        postfix_base(depth);
+        switch (below(3)) {
+            case 0: put("["); exp(depth + 1); put("]"); break;
+            case 1: put("."); put(fresh_ident()); break;
+            default: put("."); put("*"); break;
+        }
+    }
+
+    // Something call_or_access can follow without parentheses.
+    void postfix_base(int depth) {
+        if (chance(0.8)) {
+            put(variable());
+        } else {
+            put("(");
+            exp(depth + 1);
+            put(")");
+        }
+    }
+
+    void call(int depth) {
+        if (chance(0.9)) {
+            put(callable());
+        } else {
+            postfix_base(depth);
+        }
+        put("(");
+        for (size_t i = 0, n = below(4); i < n; ++i) {
+            if (i > 0) put(",");
+            exp(depth + 1);
+        }
+        put(")");
+    }
+
+    // An expression that binds at least as tightly as a unary operator.
+    void operand(int depth) {
+        if (depth >= m_options.max_depth) {
+            atom();
+            return;
+        }
+        switch (below(8)) {
+            case 0: put(chance(0.5) ? "-" : "not"); operand(depth + 1); break;
+            case 1: put("("); exp(depth + 1); put(")"); break;
+            case 2: call(depth); break;
+            case 3: place(depth); break;
+            case 4: put("new"); type(depth + 1); break;
+            case 5: put("["); type(depth + 1); put(";"); exp(depth + 1); put("]"); break;
+            default: atom(); break;
+        }
+    }
+
+    void atom() {
+        switch (below(6)) {
+            case 0: case 1: put(variable()); break;
+            case 2: put("nil"); break;
+            default: put(std::to_string(next() % (below(4) == 0 ? 1000000000000ULL : 1000))); break;
+        }
+    }
+
+    // exp ::= operand (binop operand)⋆ with an optional `?:` around it.
+    void exp(int depth) {
+        operand(depth + 1);
+        if (depth < m_options.max_depth) {
+            for (size_t n = below(3); n > 0; --n) {
+                put(pick(BINARY_OPS));
+                operand(depth + 1);
+            }
+            if (chance(0.1)) {
+                put("?");
+                exp(depth + 1);
+                put(":");
+                operand(depth + 1);
+            }
+        }
+    }
+};
+
+} // namespace
+
+size_t generate_program(const GeneratorOptions& options, std::ostream& out) {
+    return Generator(options, out).run();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// Synthetic Cflat programs for load testing.
+//
+// The output is syntactically valid Cflat: structs, externs and functions
+// with `let` locals, nested if/else and while blocks, and every expression
+// form, at whatever size is asked for. With a non-zero error density, stray
+// characters are sprinkled between tokens so the lexer produces Error
+// tokens too. The same options and seed always produce the same bytes.
+struct GeneratorOptions {
+    uint64_t seed = 1;
+    size_t target_bytes = 64 * 1024;  // stop after the item that crosses this
+    int max_depth = 4;                // nesting of blocks, types and expressions
+    int ident_length = 8;             // typical identifier length
+    double error_density = 0.0;       // chance of an error lexeme before each token
+};
+
+// Writes a program to `out`; returns the number of bytes written.
+size_t generate_program(const GeneratorOptions& options, std::ostream& out);
@@ -1,104 +1,250 @@
+#include <algorithm>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <memory>
 #include <vector>
+#include "batch.hpp"
+#include "lex_output.hpp"
+#include "result_cache.hpp"
+#include "token_file.hpp"
 #include "lexer.hpp"
+#include "stats.hpp"
+#include "watch.hpp"
 
-// Helper function to get string representation of a TokenType
-std::string token_type_to_string(const Token& token) {
-    std::string lexeme(token.first, token.last - token.first);
-    switch (token.token_type) {
-        // case TokenType::Error: return "Error(" + lexeme + ")";
-        case TokenType::Error: {
-            // Check if lexeme ends with newline, if so add extra newline before closing paren
-            if (!lexeme.empty() && lexeme.back() == '\n') {
-                return "Error(" + lexeme + "\n)";
-            }
-            return "Error(" + lexeme + ")";
+// Lexes a file's source and prints its tokens to `out`; diagnostics go to
+// `err`, including unmatched brackets if `context` indexes them (--brackets).
+static void lex_source(const std::string& path, const PaddedSource& source, LexEngine engine, bool show_locations,
+                       LexContext& context, std::ostream& out, std::ostream& err, Stats& stats, bool show_stats) {
+    // Lex the source code
+    stats.begin("lex");
+    const std::vector<Token>& tokens = engine == LexEngine::Handwritten ? context.lex_padded(source.begin(), source.end())
+                                                                        : context.lex(source.begin(), source.end(), engine);
+
+    stats.begin("print");
+    print_tokens(tokens, out);
+    stats.end();
+
+    if (show_locations) {
+        report_error_tokens(path, source.begin(), source.end(), tokens, err);
+    }
+    if (context.indexes_brackets()) {
+        report_unmatched_brackets(path, source.begin(), source.end(), tokens, context.brackets(), err);
+    }
+
+    if (show_stats) {
+        stats.input_bytes = source.size();
+        stats.tokens = tokens.size();
+        for (const Token& token : tokens) {
+            ++stats.token_counts[token_type_name(token.token_type)];
         }
-        case TokenType::Num: return "Num(" + lexeme + ")";
-        case TokenType::Id: return "Id(" + lexeme + ")";
+    }
+}
 
-        // Keywords
-        case TokenType::Int:       return "Int";
-        case TokenType::Struct:    return "Struct";
-        case TokenType::Nil:       return "Nil";
-        case TokenType::Break:     return "Break";
-        case TokenType::Continue:  return "Continue";
-        case TokenType::Return:    return "Return";
-        case TokenType::If:        return "If";
-        case TokenType::Else:      return "Else";
-        case TokenType::While:     return "While";
-        case TokenType::New:       return "New";
-        case TokenType::Let:       return "Let";
-        case TokenType::Extern:    return "Extern";
-        case TokenType::Fn:        return "Fn";
-        case TokenType::And:       return "And";
-        case TokenType::Or:        return "Or";
-        case TokenType::Not:       return "Not";
+// Reads and lexes one file, through `cache` if there is one. Returns false if
+// the file couldn't be read.
+static bool lex_file(const std::string& path, LexEngine engine, bool show_locations, LexContext& context,
+                     ResultCache* cache, std::ostream& out, std::ostream& err, Stats& stats, bool show_stats) {
+    stats.begin("read");
 
-        // Punctuation and Operators
-        case TokenType::Colon:        return "Colon";
-        case TokenType::Semicolon:    return "Semicolon";
-        case TokenType::Comma:        return "Comma";
-        case TokenType::Arrow:        return "Arrow";
-        case TokenType::Ampersand:    return "Ampersand";
-        case TokenType::Plus:         return "Plus";
-        case TokenType::Dash:         return "Dash";
-        case TokenType::Star:         return "Star";
-        case TokenType::Slash:        return "Slash";
-        case TokenType::Equal:        return "Equal";
-        case TokenType::NotEq:        return "NotEq";
-        case TokenType::Lt:           return "Lt";
-        case TokenType::Lte:          return "Lte";
-        case TokenType::Gt:           return "Gt";
-        case TokenType::Gte:          return "Gte";
-        case TokenType::Dot:          return "Dot";
-        case TokenType::Gets:         return "Gets";
-        case TokenType::OpenParen:    return "OpenParen";
-        case TokenType::CloseParen:   return "CloseParen";
-        case TokenType::OpenBracket:  return "OpenBracket";
-        case TokenType::CloseBracket: return "CloseBracket";
-        case TokenType::OpenBrace:    return "OpenBrace";
-        case TokenType::CloseBrace:   return "CloseBrace";
-        case TokenType::QuestionMark: return "QuestionMark";
+    PaddedSource source;
+    if(!source.read_file(path.c_str())) {
+        err << "Could not open file: " << path << std::endl;
+        return false;
     }
-    return "Unknown";
+    if (!cache) {
+        lex_source(path, source, engine, show_locations, context, out, err, stats, show_stats);
+        return true;
+    }
+    // Every engine prints the same tokens, so only --locations and
+    // --brackets, whose diagnostics name the file, are part of the key.
+    std::string variant = show_locations ? "lex --locations " + path : "lex";
+    if (context.indexes_brackets()) variant += " --brackets " + path;
+    cache->run(ResultCache::key(source.begin(), source.end(), variant), source.size(), out, err,
+               [&](std::ostream& fresh_out, std::ostream& fresh_err) {
+        lex_source(path, source, engine, show_locations, context, fresh_out, fresh_err, stats, show_stats);
+    });
+    return true;
 }
 
+// Lexes and prints one file like lex_file, and also writes its tokens and
+// source to a token file for `parse --read-tokens`. Returns false if the file
+// couldn't be read or the token file written.
+static bool lex_file_to_token_file(const std::string& path, const std::string& tokens_path, LexEngine engine,
+                                   bool show_locations, LexContext& context, Stats& stats, bool show_stats) {
+    stats.begin("read");
+    PaddedSource source;
+    if (!source.read_file(path)) {
+        std::cerr << "Could not open file: " << path << std::endl;
+        return false;
+    }
+    lex_source(path, source, engine, show_locations, context, std::cout, std::cerr, stats, show_stats);
+    try {
+        stats.begin("write");
+        token_file::write_token_file(tokens_path, source.begin(), source.end(), context.tokens());
+        stats.end();
+    } catch (const std::runtime_error& e) {
+        stats.end();
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
 
-int main(int argc, char** argv) {
-    if(argc != 2) {
-        std::cerr << "Usage: " << argv[0] << " <input-file>" << std::endl;
-        return 1;
+// Keeps the source each file had when it was last lexed, so saving a file
+// without changing it costs a read and a compare.
+static int watch_files(const std::vector<std::string>& paths, LexEngine engine, bool show_locations, bool brackets) {
+    std::vector<std::unique_ptr<PaddedSource>> sources(paths.size());
+    LexContext context;
+    if (brackets) context.index_brackets();
+    try {
+        run_watch(paths, std::cout, std::cerr, [&](size_t index, std::ostream& out, std::ostream& err) {
+            const std::string& path = paths[index];
+            auto source = std::make_unique<PaddedSource>();
+            if (!source->read_file(path)) {
+                sources[index].reset();
+                err << "Could not open file: " << path << std::endl;
+                return true;
+            }
+            const PaddedSource* last = sources[index].get();
+            if (last && last->size() == source->size() && std::equal(last->begin(), last->end(), source->begin())) {
+                return false;
+            }
+            Stats stats;
+            lex_source(path, *source, engine, show_locations, context, out, err, stats, false);
+            sources[index] = std::move(source);
+            return true;
+        });
+    } catch (const std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
     }
+    return 1;
+}
 
-    std::ifstream input_file(argv[1]);
-    if(!input_file) {
-        std::cerr << "Could not open file: " << argv[1] << std::endl;
+static void usage(const char* argv0) {
+    std::cerr << "Usage: " << argv0 << " [--stats] [--perf] [--table | --structural] [--locations] [--brackets] [--write-tokens <path>] <input-file>" << std::endl;
+    std::cerr << "       " << argv0 << " [--table | --structural] [--locations] [--brackets] [--jobs <n>] [--out-dir <dir>]" << std::endl;
+    std::cerr << "           [--files-from <list>] <input-file>..." << std::endl;
+    std::cerr << "       either with [--cache <dir> [--cache-size <MB>] [--cache-stats]]" << std::endl;
+    std::cerr << "       " << argv0 << " --watch [--table | --structural] [--locations] [--brackets] <input-file>..." << std::endl;
+}
+
+int main(int argc, char** argv) {
+    bool show_stats = false;
+    bool show_perf = false;
+    bool show_locations = false;
+    bool brackets = false;
+    LexEngine engine = LexEngine::Handwritten;
+    std::vector<std::string> paths;
+    std::string files_from;
+    std::string out_dir;
+    size_t jobs = 0;
+    bool watch = false;
+    std::string cache_dir;
+    uint64_t cache_size = uint64_t(256) << 20;
+    bool show_cache_stats = false;
+    std::string write_tokens_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--table") {
+            engine = LexEngine::Table;
+        } else if (arg == "--structural") {
+            engine = LexEngine::Structural;
+        } else if (arg == "--locations") {
+            show_locations = true;
+        } else if (arg == "--brackets") {
+            brackets = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--perf") {
+            show_stats = show_perf = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            if (!parse_jobs(argv[++i], jobs)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--files-from" && i + 1 < argc) {
+            files_from = argv[++i];
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            if (!parse_cache_size(argv[++i], cache_size)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (arg == "--cache-stats") {
+            show_cache_stats = true;
+        } else if (arg == "--write-tokens" && i + 1 < argc) {
+            write_tokens_path = argv[++i];
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (!files_from.empty()) {
+        try {
+            std::vector<std::string> listed = read_file_list(files_from);
+            paths.insert(paths.end(), listed.begin(), listed.end());
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    bool batch = paths.size() > 1 || !files_from.empty() || !out_dir.empty() || jobs != 0;
+    bool cache_options = !cache_dir.empty() || show_cache_stats;
+    if (paths.empty() || (batch && show_stats) || (watch && (show_stats || !out_dir.empty() || jobs != 0 || cache_options))
+            || (show_cache_stats && cache_dir.empty())
+            || (!write_tokens_path.empty() && (batch || watch || cache_options))) {
+        usage(argv[0]);
         return 1;
     }
 
-    // Read the entire file into a string
-    std::stringstream buffer;
-    buffer << input_file.rdbuf();
-    std::string source_code = buffer.str();
-
-    // Lex the source code
-    const char* first = source_code.c_str();
-    const char* last = first + source_code.length();
+    if (watch) {
+        return watch_files(paths, engine, show_locations, brackets);
+    }
 
-    std::vector<Token> tokens = lex(first, last);
+    std::unique_ptr<ResultCache> cache;
+    if (!cache_dir.empty()) {
+        try {
+            cache = std::make_unique<ResultCache>(cache_dir, cache_size);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
 
-    for (size_t i = 0; i < tokens.size(); ++i) {
-        const Token& token = tokens[i];
-        std::cout << token_type_to_string(token);
-        if (i != tokens.size() - 1) {
-            std::cout << " ";
+    int status = 0;
+    if (!batch) {
+        Stats stats;
+        if (show_perf) stats.enable_perf();
+        LexContext context;
+        if (brackets) context.index_brackets();
+        bool lexed = write_tokens_path.empty()
+            ? lex_file(paths[0], engine, show_locations, context, cache.get(), std::cout, std::cerr, stats, show_stats)
+            : lex_file_to_token_file(paths[0], write_tokens_path, engine, show_locations, context, stats, show_stats);
+        if (!lexed) {
+            status = 1;
+        } else if (show_stats) {
+            stats.report(std::cerr);
+        }
+    } else {
+        // Batch mode: each worker keeps its own LexContext, so after its first
+        // few files it lexes without allocating.
+        std::vector<LexContext> contexts(jobs == 0 ? default_batch_threads() : jobs);
+        if (brackets) {
+            for (LexContext& context : contexts) context.index_brackets();
         }
+        status = run_batch_files(paths, contexts.size(), out_dir, ".lex", std::cout, std::cerr,
+                                 [&](const std::string& path, size_t worker, std::ostream& out, std::ostream& err) {
+            Stats stats;
+            return lex_file(path, engine, show_locations, contexts[worker], cache.get(), out, err, stats, false);
+        });
     }
-    std::cout << std::endl;
-    // std::cout << std::endl;
 
-    return 0;
-}
\ No newline at end of file
+    if (cache) {
+        cache->evict();
+        if (show_cache_stats) cache->report(std::cerr);
+    }
+    return status;
+}
@@ -0,0 +1,63 @@
+#include "lex_output.hpp"
+#include "source_location.hpp"
+
+// Helper function to get string representation of a TokenType
+static std::string token_type_to_string(const Token& token) {
+    std::string lexeme(token.first, token.last - token.first);
+    switch (token.token_type) {
+        // case TokenType::Error: return "Error(" + lexeme + ")";
+        case TokenType::Error: {
+            // Check if lexeme ends with newline, if so add extra newline before closing paren
+            if (!lexeme.empty() && lexeme.back() == '\n') {
+                return "Error(" + lexeme + "\n)";
+            }
+            return "Error(" + lexeme + ")";
+        }
+        case TokenType::Num: return "Num(" + lexeme + ")";
+        case TokenType::Id: return "Id(" + lexeme + ")";
+        default: return token_type_name(token.token_type);
+    }
+    return "Unknown";
+}
+
+void print_tokens(const std::vector<Token>& tokens, std::ostream& out) {
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        const Token& token = tokens[i];
+        out << token_type_to_string(token);
+        if (i != tokens.size() - 1) {
+            out << " ";
+        }
+    }
+    out << std::endl;
+}
+
+// Error tokens are rare, so the line index is only built if one turns up.
+void report_error_tokens(const std::string& path, const char* first, const char* last,
+                         const std::vector<Token>& tokens, std::ostream& err) {
+    LineIndex lines(first, last);
+    for (const Token& token : tokens) {
+        if (token.token_type != TokenType::Error) continue;
+        SourceLocation loc = lines.locate(token);
+        err << path << ":" << loc.line << ":" << loc.column << ": error token" << std::endl;
+    }
+}
+
+void report_unmatched_brackets(const std::string& path, const char* first, const char* last,
+                               const std::vector<Token>& tokens, const BracketIndex& index, std::ostream& err) {
+    if (index.balanced) return;
+    LineIndex lines(first, last);
+    for (size_t i = index.first_unmatched; i < tokens.size(); ++i) {
+        if (index.match[i] != BracketIndex::NO_MATCH) continue;
+        switch (tokens[i].token_type) {
+            case TokenType::OpenParen: case TokenType::CloseParen:
+            case TokenType::OpenBracket: case TokenType::CloseBracket:
+            case TokenType::OpenBrace: case TokenType::CloseBrace:
+                break;
+            default:
+                continue;
+        }
+        SourceLocation loc = lines.locate(tokens[i]);
+        err << path << ":" << loc.line << ":" << loc.column << ": unmatched " << token_type_name(tokens[i].token_type)
+            << std::endl;
+    }
+}
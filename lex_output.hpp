@@ -0,0 +1,23 @@
+#pragma once
+
+#include "lexer.hpp"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The output of `lex`, shared with the compile server so a result reads the
+// same whichever of them produced it.
+
+// Prints the tokens the way `lex` does: space-separated on one line.
+void print_tokens(const std::vector<Token>& tokens, std::ostream& out);
+
+// Writes "path:line:col: error token" to `err` for every Error token.
+// [first, last) is the source the tokens point into.
+void report_error_tokens(const std::string& path, const char* first, const char* last,
+                         const std::vector<Token>& tokens, std::ostream& err);
+
+// Writes "path:line:col: unmatched <token>" to `err` for every bracket
+// without a partner in `index`, the BracketIndex of `tokens`.
+void report_unmatched_brackets(const std::string& path, const char* first, const char* last,
+                               const std::vector<Token>& tokens, const BracketIndex& index, std::ostream& err);
@@ -1,20 +1,37 @@
+#include <algorithm>
 #include <cstring>
 #include <cctype>
+#include <cerrno>
 #include <optional>
 #include <utility> 
+#include <string_view>
+#include <unordered_map>
 
 #include "lexer.hpp"
+#include "lexer_structural.hpp"
+#include "lexer_table.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 static bool substr_eq(const char* first, const char* last, const char* pattern);
-static std::pair<const char*, std::optional<Token>> skip_whitespace_and_comments(const char* first, const char* last);
-static const char* identifier_end(const char* first, const char* last);
-static const char* numeric_end(const char* first, const char* last);
-static const char* error_end(const char* first, const char* last);
 
-// helpers
+// The helpers below are templates over `Padded`. A padded buffer has a NUL at
+// `last` and LEX_PADDING readable bytes after it, so scanning loops stop on
+// the sentinel (no identifier, number or space character is NUL) and only
+// compare against `last` when they actually see a NUL, which may also occur
+// inside the source. Unpadded buffers check `last` before every read.
+
+template <bool Padded>
+static bool at_end(const char* p, const char* last) {
+    return Padded ? *p == '\0' && p == last : p >= last;
+}
+
+template <bool Padded>
 static bool starts_two_char_token(const char* p, const char* last) {
-    if (p + 1 >= last) return false;
+    if (!Padded && p + 1 >= last) return false;
     return (p[0] == '!' && p[1] == '=') ||
            (p[0] == '<' && p[1] == '=') ||
            (p[0] == '>' && p[1] == '=') ||
@@ -36,54 +53,134 @@ static bool starts_one_char_token(char c) {
     }
 }
 
+template <bool Padded>
 static bool starts_token(const char* p, const char* last) {
-    if (p >= last) return false;
+    if (at_end<Padded>(p, last)) return false;
     if (std::isalpha(static_cast<unsigned char>(*p))) return true; // Id/keyword
     if (std::isdigit(static_cast<unsigned char>(*p))) return true; // Num
-    if (starts_two_char_token(p, last)) return true;
+    if (starts_two_char_token<Padded>(p, last)) return true;
     if (starts_one_char_token(*p)) return true;
     return false;
 }
 
+/**
+ * Look for the next character which is either a space or the beginning of the
+ * next (possibly) valid token.
+ */
+template <bool Padded>
+static const char* error_end(const char* first, const char* last) {
+    const char* it = first;
+    // Always consume at least one char
+    if (it < last) ++it;
 
+    while (!at_end<Padded>(it, last)) {
+        if (starts_token<Padded>(it, last)) break;   // stop BEFORE next token
+        ++it;                                 // keep absorbing (incl. spaces/newlines)
+    }
+    return it; // one-past-end of Error(...) lexeme
+}
 
 /**
- * The entry point of our lexer
- *
- * `first` is a pointer to the first character of the source code string.
- * `last` is a pointer to one-past-the-end of the source code.
+ * Return one-past-the-end of an identifier sequence of characters: [a-zA-Z]([a-zA-Z0-9_])⋆
  */
-std::vector<Token> lex(const char* first, const char* last) {
-    std::vector<Token> tokens{};
+template <bool Padded>
+static const char* identifier_end(const char* first, const char* last) {
+    if (first == last || !(std::isalpha(static_cast<unsigned char>(*first)))) {
+        return first; // not a valid identifier start
+    }
+    for(const char* it = first; Padded || it != last; ++it) {
+        if(!(std::isalnum(static_cast<unsigned char>(*it)) || '_' == *it)) {
+            return it;
+        }
+    }
+    return last;
+}
 
-    const char* curr = first;
-    while(curr != last) {
-        auto [next_char, opt_error_token] = skip_whitespace_and_comments(curr, last);
-        curr = next_char;
-        // Check if the skipper returned an error token.
-        if (opt_error_token) {
-            // If it did, add it to our list of tokens.
-            tokens.push_back(*opt_error_token);
-            // An unclosed comment error consumes the rest of the file, so we stop.
-            break;
+/**
+ * Return one-past-the-end of a numeric sequence of characters: [0-9]+: [0-9]([0-9])⋆
+ * and store its value (or NUM_OVERFLOW) in `value` along the way.
+ */
+template <bool Padded>
+static const char* numeric_end(const char* first, const char* last, int64_t& value) {
+    value = 0;
+    if (first == last || !std::isdigit(static_cast<unsigned char>(*first))) {
+        return first; // not a valid numeric start
+    }
+    for(const char* it = first; Padded || it != last; ++it) {
+        if(!(std::isdigit(static_cast<unsigned char>(*it)))) {
+            return it;
         }
-        // If we're at the end of the file after skipping, we're done.
-        if (curr == last) {
-            break;
+        if (value != NUM_OVERFLOW &&
+            (__builtin_mul_overflow(value, 10, &value) || __builtin_add_overflow(value, *it - '0', &value))) {
+            value = NUM_OVERFLOW;
         }
-        Token tok = munch_token(curr, last);
-        tokens.push_back(tok);
+    }
+    return last;
+}
 
-        curr = tok.last;
+/** *
+ * Skip whitespace and comments
+ */
+template <bool Padded>
+static std::pair<const char*, std::optional<Token>>
+skip_whitespace_and_comments(const char* first, const char* last) {
+    const char* it = first;
+
+    for (;;) {
+        // 1) whitespace
+        while ((Padded || it != last) && std::isspace(static_cast<unsigned char>(*it))) {
+            ++it;
+        }
+
+        // 2) C++-style // comment  -> consume until newline OR EOF
+        if ((Padded || it + 1 < last) && it[0] == '/' && it[1] == '/') {
+            const char* start_comment = it;    // for Error token if needed
+            it += 2;                           // skip //
+            while (!at_end<Padded>(it, last) && *it != '\n') {
+                ++it;
+            } // eat until newline
+            if (at_end<Padded>(it, last)) {
+                Token err_tok{TokenType::Error, start_comment, last};
+                return {last, err_tok};
+            }
+            ++it;                              // eat the newline itself
+            continue;                          // loop to skip more ws/comments
+        }
+
+        // 3) C-style /* ... */ comment  -> error if unterminated
+        if ((Padded || it + 1 < last) && it[0] == '/' && it[1] == '*') {
+            const char* start_comment = it;    // for Error token if needed
+            it += 2;
+            bool closed = false;
+            while (Padded ? !at_end<Padded>(it, last) : it + 1 < last) {
+                if (it[0] == '*' && it[1] == '/') {
+                    it += 2;
+                    closed = true;
+                    break;
+                }
+                ++it;
+            }
+            if (!closed) {
+                // Unterminated comment is a lexer error: Error("/*...<EOF>")
+                Token err_tok{TokenType::Error, start_comment, last};
+                return {last, err_tok};
+            }
+            continue;                          // there may be more ws/comments
+        }
+
+        // nothing more to skip
+        break;
     }
-    return tokens;
+
+    return {it, std::nullopt};
 }
 
 /**
  * Lex one token from the source code.
  * The function will try to lex a token beginning at `first`.
  */
-Token munch_token(const char* first, const char* last) {
+template <bool Padded>
+static Token munch(const char* first, const char* last) {
     // Return a single Token.
     // If we haven't returned, we have not yet found a token.
 
@@ -94,7 +191,7 @@ Token munch_token(const char* first, const char* last) {
     // Try to munch an identifier or keyword
 
     if(std::isalpha(static_cast<unsigned char>(*first))) {
-        const char* id_end = identifier_end(first, last);
+        const char* id_end = identifier_end<Padded>(first, last);
         // Prioritize keywords
         if(substr_eq(first, id_end, "int")) return Token{TokenType::Int, first, id_end};
         if(substr_eq(first, id_end, "struct")) return Token{TokenType::Struct, first, id_end};
@@ -118,13 +215,14 @@ Token munch_token(const char* first, const char* last) {
 
     // Try to munch a number
     if(std::isdigit(static_cast<unsigned char>(*first))) {
-        const char* num_end = numeric_end(first, last);
-        return Token{TokenType::Num, first, num_end};
+        int64_t value;
+        const char* num_end = numeric_end<Padded>(first, last, value);
+        return Token{TokenType::Num, first, num_end, value};
     }
 
     // Try to munch operators and punctuation
     // Check longest operators first for max munch
-    if (last - first >= 2) {
+    if (Padded || last - first >= 2) {
         if (substr_eq(first, first + 2, "!=")) {
             return Token{TokenType::NotEq, first, first + 2};
         }
@@ -165,113 +263,287 @@ Token munch_token(const char* first, const char* last) {
 
     // Nothing matched, so we have an error token.
     // We will consume characters until we reach whitespace or a character
-    const char* err_end = error_end(first, last);
+    const char* err_end = error_end<Padded>(first, last);
     return Token{TokenType::Error, first, err_end};
 }
 
+template <bool Padded>
+static void lex_tokens(const char* first, const char* last, std::vector<Token>& tokens) {
+    const char* curr = first;
+    while(curr != last) {
+        auto [next_char, opt_error_token] = skip_whitespace_and_comments<Padded>(curr, last);
+        curr = next_char;
+        // Check if the skipper returned an error token.
+        if (opt_error_token) {
+            // If it did, add it to our list of tokens.
+            tokens.push_back(*opt_error_token);
+            // An unclosed comment error consumes the rest of the file, so we stop.
+            break;
+        }
+        // If we're at the end of the file after skipping, we're done.
+        if (curr == last) {
+            break;
+        }
+        Token tok = munch<Padded>(curr, last);
+        tokens.push_back(tok);
+
+        curr = tok.last;
+    }
+}
+
 /**
- * Look for the next character which is either a space or the beginning of the
- * next (possibly) valid token.
+ * lex_tokens<false> as a coroutine, yielding where that pushes.
  */
-static const char* error_end(const char* first, const char* last) {
-    const char* it = first;
-    // Always consume at least one char
-    if (it < last) ++it;
+Generator<Token> lex_lazily(const char* first, const char* last) {
+    const char* curr = first;
+    while (curr != last) {
+        auto [next_char, opt_error_token] = skip_whitespace_and_comments<false>(curr, last);
+        if (opt_error_token) {
+            co_yield *opt_error_token;
+            co_return;
+        }
+        if (next_char == last) {
+            co_return;
+        }
+        Token tok = munch<false>(next_char, last);
+        co_yield tok;
+        curr = tok.last;
+    }
+}
 
-    while (it < last) {
-        if (starts_token(it, last)) break;   // stop BEFORE next token
-        ++it;                                 // keep absorbing (incl. spaces/newlines)
+static void lex_into(const char* first, const char* last, LexEngine engine,
+                     std::vector<Token>& tokens, std::vector<uint64_t>& scratch) {
+    if (engine == LexEngine::Table) {
+        lex_table(first, last, tokens);
+    } else if (engine == LexEngine::Structural) {
+        lex_structural(first, last, tokens, scratch);
+    } else {
+        lex_tokens<false>(first, last, tokens);
     }
-    return it; // one-past-end of Error(...) lexeme
 }
 
+/**
+ * The entry point of our lexer
+ *
+ * `first` is a pointer to the first character of the source code string.
+ * `last` is a pointer to one-past-the-end of the source code.
+ */
+std::vector<Token> lex(const char* first, const char* last, LexEngine engine) {
+    std::vector<Token> tokens{};
+    std::vector<uint64_t> scratch;
+    lex_into(first, last, engine, tokens, scratch);
+    return tokens;
+}
 
+/**
+ * Like lex, for a buffer with a NUL at `last` and LEX_PADDING readable bytes
+ * after it, as PaddedSource provides.
+ */
+std::vector<Token> lex_padded(const char* first, const char* last) {
+    std::vector<Token> tokens{};
+    lex_tokens<true>(first, last, tokens);
+    return tokens;
+}
 
 /**
- * Return one-past-the-end of an identifier sequence of characters: [a-zA-Z]([a-zA-Z0-9_])⋆
+ * A token ending before `available` is final: the scanners decide where a
+ * token ends by looking at the byte after it, and that byte was there. One
+ * that runs up to `available` (including a `/` that might start a comment,
+ * or a comment that never closed) is left for the next call. A comment left
+ * open is searched for its end from where the last call stopped: the pair
+ * check for a block comment's `*` `/` never looked at a `*` in the last byte,
+ * so that byte is searched again.
  */
-const char* identifier_end(const char* first, const char* last) {
-    if (first == last || !(std::isalpha(static_cast<unsigned char>(*first)))) {
-        return first; // not a valid identifier start
+void lex_prefix(LexPrefixState& state, const char* available, bool complete, std::vector<Token>& tokens) {
+    const char* curr = state.resume;
+    if (state.comment_scanned && !complete) {
+        bool block = curr[1] == '*';
+        const char* it = block ? std::max(curr + 2, state.comment_scanned - 1) : state.comment_scanned;
+        const char* end = nullptr;
+        if (block) {
+            for (; it + 1 < available; ++it) {
+                if (it[0] == '*' && it[1] == '/') {
+                    end = it + 2;
+                    break;
+                }
+            }
+        } else {
+            const char* newline = std::find(it, available, '\n');
+            if (newline != available) end = newline + 1;
+        }
+        if (!end) {
+            state.comment_scanned = available;
+            return;
+        }
+        curr = end;
     }
-    for(const char* it = first; it != last; ++it) {
-        if(!(std::isalnum(static_cast<unsigned char>(*it)) || '_' == *it)) {
-            return it;
+    state.comment_scanned = nullptr;
+    if (complete) {
+        lex_tokens<false>(curr, available, tokens);
+        state.resume = available;
+        return;
+    }
+    while (curr != available) {
+        auto [next_char, opt_error_token] = skip_whitespace_and_comments<false>(curr, available);
+        if (opt_error_token) {
+            // Only an unclosed comment is an error here.
+            state.resume = opt_error_token->first;
+            state.comment_scanned = available;
+            return;
+        }
+        if (next_char == available) {
+            curr = available;
+            break;
+        }
+        Token tok = munch<false>(next_char, available);
+        if (tok.last == available) {
+            curr = next_char;
+            break;
         }
+        tokens.push_back(tok);
+        curr = tok.last;
     }
-    return last;
+    state.resume = curr;
 }
 
 /**
- * Return one-past-the-end of a numeric sequence of characters: [0-9]+: [0-9]([0-9])⋆
+ * The pass behind index_brackets, with the stack passed in so LexContext
+ * can keep it. An opener is pushed; a closer pairs with the innermost open
+ * bracket of its kind, and any opened inside that one are left unmatched,
+ * so `( [ )` pairs the parentheses and flags only the `[`. A closer with
+ * none of its kind open is unmatched and leaves the stack alone. Counting
+ * the open brackets of each kind tells which case it is before searching,
+ * so every bracket is pushed and popped at most once.
  */
-const char* numeric_end(const char* first, const char* last) {
-    if (first == last || !std::isdigit(static_cast<unsigned char>(*first))) {
-        return first; // not a valid numeric start
-    }
-    for(const char* it = first; it != last; ++it) {
-        if(!(std::isdigit(static_cast<unsigned char>(*it)))) {
-            return it;
+static void index_brackets_into(const std::vector<Token>& tokens, BracketIndex& index, std::vector<uint32_t>& open) {
+    index.match.assign(tokens.size(), BracketIndex::NO_MATCH);
+    open.clear();
+    uint32_t first_unmatched = BracketIndex::NO_MATCH;
+    size_t open_count[3] = {0, 0, 0};  // parentheses, brackets, braces
+    auto kind = [&](uint32_t i) {
+        switch (tokens[i].token_type) {
+            case TokenType::OpenBracket: return 1;
+            case TokenType::OpenBrace: return 2;
+            default: return 0;
+        }
+    };
+    for (uint32_t i = 0; i < tokens.size(); ++i) {
+        int closes;
+        switch (tokens[i].token_type) {
+            case TokenType::OpenParen:
+            case TokenType::OpenBracket:
+            case TokenType::OpenBrace:
+                open.push_back(i);
+                ++open_count[kind(i)];
+                continue;
+            case TokenType::CloseParen: closes = 0; break;
+            case TokenType::CloseBracket: closes = 1; break;
+            case TokenType::CloseBrace: closes = 2; break;
+            default: continue;
+        }
+        if (open_count[closes] == 0) {
+            first_unmatched = std::min(first_unmatched, i);
+            continue;
+        }
+        while (kind(open.back()) != closes) {
+            first_unmatched = std::min(first_unmatched, open.back());
+            --open_count[kind(open.back())];
+            open.pop_back();
         }
+        index.match[i] = open.back();
+        index.match[open.back()] = i;
+        --open_count[closes];
+        open.pop_back();
     }
-    return last;
+    // The bottom of the stack is the earliest opener left.
+    if (!open.empty()) {
+        first_unmatched = std::min(first_unmatched, open.front());
+    }
+    index.first_unmatched = first_unmatched;
+    index.balanced = first_unmatched == BracketIndex::NO_MATCH;
 }
 
-/** *
- * Skip whitespace and comments
+BracketIndex index_brackets(const std::vector<Token>& tokens) {
+    BracketIndex index;
+    std::vector<uint32_t> open;
+    index_brackets_into(tokens, index, open);
+    return index;
+}
+
+/**
+ * Generated and hand-written Cflat averages four to five bytes per token, so
+ * this is enough for nearly every file without regrowing.
  */
-std::pair<const char*, std::optional<Token>>
-skip_whitespace_and_comments(const char* first, const char* last) {
-    const char* it = first;
+static size_t estimate_tokens(size_t bytes) {
+    return bytes / 4 + 16;
+}
 
-    for (;;) {
-        // 1) whitespace
-        while (it != last && std::isspace(static_cast<unsigned char>(*it))) {
-            ++it;
-        }
+const std::vector<Token>& LexContext::lex(const char* first, const char* last, LexEngine engine) {
+    m_tokens.clear();
+    m_tokens.reserve(estimate_tokens(static_cast<size_t>(last - first)));
+    lex_into(first, last, engine, m_tokens, m_scratch);
+    if (m_index_brackets) index_brackets_into(m_tokens, m_brackets, m_open);
+    return m_tokens;
+}
 
-        // 2) C++-style // comment  -> consume until newline OR EOF
-        if (it + 1 < last && it[0] == '/' && it[1] == '/') {
-            const char* start_comment = it;    // for Error token if needed
-            it += 2;                           // skip //
-            while (it != last && *it != '\n') {
-                ++it;
-            } // eat until newline
-            if (it == last) {
-                Token err_tok{TokenType::Error, start_comment, last};
-                return {last, err_tok};
-            }
-            else if (it != last && *it == '\n')     // eat the newline itself
-                ++it;
-            continue;                          // loop to skip more ws/comments
-        }
+const std::vector<Token>& LexContext::lex_padded(const char* first, const char* last) {
+    m_tokens.clear();
+    m_tokens.reserve(estimate_tokens(static_cast<size_t>(last - first)));
+    lex_tokens<true>(first, last, m_tokens);
+    if (m_index_brackets) index_brackets_into(m_tokens, m_brackets, m_open);
+    return m_tokens;
+}
 
-        // 3) C-style /* ... */ comment  -> error if unterminated
-        if (it + 1 < last && it[0] == '/' && it[1] == '*') {
-            const char* start_comment = it;    // for Error token if needed
-            it += 2;
-            bool closed = false;
-            while (it + 1 < last) {
-                if (it[0] == '*' && it[1] == '/') {
-                    it += 2;
-                    closed = true;
-                    break;
-                }
-                ++it;
-            }
-            if (!closed) {
-                // Unterminated comment is a lexer error: Error("/*...<EOF>")
-                Token err_tok{TokenType::Error, start_comment, last};
-                return {last, err_tok};
-            }
-            continue;                          // there may be more ws/comments
-        }
+Token munch_token(const char* first, const char* last) {
+    return munch<false>(first, last);
+}
 
-        // nothing more to skip
-        break;
+int64_t num_value(const char* first, const char* last) {
+    int64_t value = 0;
+    if (first == last || numeric_end<false>(first, last, value) != last) {
+        return NUM_OVERFLOW;
     }
+    return value;
+}
 
-    return {it, std::nullopt};
+PaddedSource::PaddedSource(std::string text) : m_text(std::move(text)), m_size(m_text.size()) {
+    m_text.append(LEX_PADDING, '\0');
+}
+
+/**
+ * A regular file is read straight into one buffer of its size plus the
+ * padding. Anything else (a pipe, /dev/stdin) is read into a buffer that
+ * doubles as it fills. Either way the bytes after the source are the NULs
+ * the buffer was allocated with.
+ */
+bool PaddedSource::read_file(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    bool regular = ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    size_t capacity = regular ? static_cast<size_t>(st.st_size) : size_t(64) << 10;
+    std::string text(capacity + LEX_PADDING, '\0');
+    size_t size = 0;
+    bool ok = true;
+    for (;;) {
+        if (size == capacity) {
+            if (regular) break;  // bytes appended since the fstat are left out
+            capacity *= 2;
+            text.resize(capacity + LEX_PADDING, '\0');
+        }
+        ssize_t n = ::read(fd, &text[size], capacity - size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = n == 0;
+            break;
+        }
+        size += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    if (!ok) return false;
+    m_text = std::move(text);
+    m_size = size;
+    return true;
 }
 
 /**
@@ -294,3 +566,76 @@ bool substr_eq(const char* first, const char* last, const char* pattern) {
     // return false if pattern is longer than the string.
     return '\0' == *pattern_it;
 }
+
+/**
+ * The name of a token type as the lexer prints it, e.g. "OpenParen".
+ */
+const char* token_type_name(TokenType type) {
+    switch (type) {
+        case TokenType::Error: return "Error";
+        case TokenType::Num: return "Num";
+        case TokenType::Id: return "Id";
+
+        // Keywords
+        case TokenType::Int: return "Int";
+        case TokenType::Struct: return "Struct";
+        case TokenType::Nil: return "Nil";
+        case TokenType::Break: return "Break";
+        case TokenType::Continue: return "Continue";
+        case TokenType::Return: return "Return";
+        case TokenType::If: return "If";
+        case TokenType::Else: return "Else";
+        case TokenType::While: return "While";
+        case TokenType::New: return "New";
+        case TokenType::Let: return "Let";
+        case TokenType::Extern: return "Extern";
+        case TokenType::Fn: return "Fn";
+        case TokenType::And: return "And";
+        case TokenType::Or: return "Or";
+        case TokenType::Not: return "Not";
+
+        // Punctuation and Operators
+        case TokenType::Colon: return "Colon";
+        case TokenType::Semicolon: return "Semicolon";
+        case TokenType::Comma: return "Comma";
+        case TokenType::Arrow: return "Arrow";
+        case TokenType::Ampersand: return "Ampersand";
+        case TokenType::Plus: return "Plus";
+        case TokenType::Dash: return "Dash";
+        case TokenType::Star: return "Star";
+        case TokenType::Slash: return "Slash";
+        case TokenType::Equal: return "Equal";
+        case TokenType::NotEq: return "NotEq";
+        case TokenType::Lt: return "Lt";
+        case TokenType::Lte: return "Lte";
+        case TokenType::Gt: return "Gt";
+        case TokenType::Gte: return "Gte";
+        case TokenType::Dot: return "Dot";
+        case TokenType::Gets: return "Gets";
+        case TokenType::OpenParen: return "OpenParen";
+        case TokenType::CloseParen: return "CloseParen";
+        case TokenType::OpenBracket: return "OpenBracket";
+        case TokenType::CloseBracket: return "CloseBracket";
+        case TokenType::OpenBrace: return "OpenBrace";
+        case TokenType::CloseBrace: return "CloseBrace";
+        case TokenType::QuestionMark: return "QuestionMark";
+    }
+    return "Unknown";
+}
+
+/**
+ * The inverse of token_type_name. Names that aren't token types map to Error,
+ * which no grammar rule accepts.
+ */
+TokenType token_type_from_name(const char* first, const char* last) {
+    static const std::unordered_map<std::string_view, TokenType> types = [] {
+        std::unordered_map<std::string_view, TokenType> map;
+        for (int t = static_cast<int>(TokenType::Error); t <= static_cast<int>(TokenType::QuestionMark); ++t) {
+            TokenType type = static_cast<TokenType>(t);
+            map.emplace(token_type_name(type), type);
+        }
+        return map;
+    }();
+    auto it = types.find(std::string_view(first, last - first));
+    return it == types.end() ? TokenType::Error : it->second;
+}
@@ -1,6 +1,9 @@
 #ifndef LEXER_HPP_
 #define LEXER_HPP_
 
+#include "coroutine_generator.hpp"
+
+#include <cstdint>
 #include <vector>
 #include <string>
 
@@ -56,6 +59,58 @@ enum class TokenType {
     QuestionMark,
 };
 
+/**
+ * The fixed spelling of every keyword and operator. Num, Id and Error have
+ * none. The table-driven lexer builds its transition table from these.
+ */
+struct TokenSpelling {
+    const char* text;
+    TokenType type;
+};
+
+inline constexpr TokenSpelling TOKEN_SPELLINGS[] = {
+    {"int", TokenType::Int},
+    {"struct", TokenType::Struct},
+    {"nil", TokenType::Nil},
+    {"break", TokenType::Break},
+    {"continue", TokenType::Continue},
+    {"return", TokenType::Return},
+    {"if", TokenType::If},
+    {"else", TokenType::Else},
+    {"while", TokenType::While},
+    {"new", TokenType::New},
+    {"let", TokenType::Let},
+    {"extern", TokenType::Extern},
+    {"fn", TokenType::Fn},
+    {"and", TokenType::And},
+    {"or", TokenType::Or},
+    {"not", TokenType::Not},
+    {":", TokenType::Colon},
+    {";", TokenType::Semicolon},
+    {",", TokenType::Comma},
+    {"->", TokenType::Arrow},
+    {"&", TokenType::Ampersand},
+    {"+", TokenType::Plus},
+    {"-", TokenType::Dash},
+    {"*", TokenType::Star},
+    {"/", TokenType::Slash},
+    {"==", TokenType::Equal},
+    {"!=", TokenType::NotEq},
+    {"<", TokenType::Lt},
+    {"<=", TokenType::Lte},
+    {">", TokenType::Gt},
+    {">=", TokenType::Gte},
+    {".", TokenType::Dot},
+    {"=", TokenType::Gets},
+    {"(", TokenType::OpenParen},
+    {")", TokenType::CloseParen},
+    {"[", TokenType::OpenBracket},
+    {"]", TokenType::CloseBracket},
+    {"{", TokenType::OpenBrace},
+    {"}", TokenType::CloseBrace},
+    {"?", TokenType::QuestionMark},
+};
+
 /**
  * A token
  */
@@ -63,9 +118,164 @@ struct Token {
     TokenType token_type;
     const char* first;  // the first character of the token
     const char* last;  // one past the last character of the token
+    int64_t value = 0;  // Num only: the value of the digits, or NUM_OVERFLOW
+
+    // Num only: the digits don't fit in an int64_t.
+    bool overflow() const { return value < 0; }
+};
+
+/**
+ * Token::value of a Num whose digits don't fit in an int64_t. A digit run is
+ * never negative, so any negative value can serve as the flag.
+ */
+constexpr int64_t NUM_OVERFLOW = -1;
+
+/**
+ * The value of the digit run [first, last), or NUM_OVERFLOW if it doesn't fit
+ * in an int64_t or isn't all digits.
+ */
+int64_t num_value(const char* first, const char* last);
+
+/**
+ * The lexer implementations behind lex(). All produce identical tokens:
+ * Handwritten is the munch_token branch chain, Table runs a state-transition
+ * table one byte per step, and Structural classifies the input into SIMD
+ * bitmaps first and then finds token ends with bit scans.
+ */
+enum class LexEngine {
+    Handwritten,
+    Table,
+    Structural,
+};
+
+std::vector<Token> lex(const char* first, const char* last, LexEngine engine = LexEngine::Handwritten);
+
+/**
+ * Bytes that must be readable past the end of a buffer given to lex_padded.
+ * Enough for the widest vector load, so scanners can overrun `last` freely.
+ */
+constexpr size_t LEX_PADDING = 64;
+
+/**
+ * Same tokens as lex, but [first, last) must be followed by a NUL at `last`
+ * and LEX_PADDING readable bytes, which lets the scanning loops drop their
+ * per-byte bounds checks.
+ */
+std::vector<Token> lex_padded(const char* first, const char* last);
+
+/**
+ * Where lex_prefix left off in a source, carried from one call to the next.
+ */
+struct LexPrefixState {
+    explicit LexPrefixState(const char* first) : resume(first) {}
+
+    // Where lexing resumes: the start of a token or comment that reached the
+    // end of what had arrived and might still grow.
+    const char* resume;
+    // Set when an unclosed comment starts at `resume`: how far it has been
+    // searched for its end, so the next call only searches the new bytes.
+    const char* comment_scanned = nullptr;
+};
+
+/**
+ * Lexes a source that is still arriving, e.g. read a chunk at a time.
+ *
+ * [state.resume, available) is what has arrived and not been lexed yet, and
+ * `complete` says whether the source ends at `available`. Appends the tokens
+ * that no later input can change and advances `state`. Lexing a source
+ * piecewise this way, with one state from its start, gives the same tokens
+ * as lex() on the whole of it, and reads each byte of a comment that spans
+ * many calls only once.
+ */
+void lex_prefix(LexPrefixState& state, const char* available, bool complete, std::vector<Token>& tokens);
+
+/**
+ * The tokens of [first, last) one at a time, lexed only as they are pulled:
+ * the same tokens as lex(), without ever holding more than one of them.
+ * The source must outlive the generator.
+ */
+Generator<Token> lex_lazily(const char* first, const char* last);
+
+/**
+ * Where the partner of each bracket is, so a consumer can get from a `{`,
+ * `[` or `(` past the whole block in one step instead of scanning for it.
+ *
+ * `match` has an entry per token: for a bracket, the index of the token that
+ * closes or opens it; for any other token, NO_MATCH. Unbalanced input is
+ * not an error: brackets left without a partner get NO_MATCH too, `balanced`
+ * is false and `first_unmatched` is the first of them.
+ */
+struct BracketIndex {
+    static constexpr uint32_t NO_MATCH = UINT32_MAX;
+
+    std::vector<uint32_t> match;
+    bool balanced = true;
+    uint32_t first_unmatched = NO_MATCH;
 };
 
-std::vector<Token> lex(const char* first, const char* last);
+/**
+ * Builds the BracketIndex of `tokens` in one pass with a stack of the open
+ * brackets. There must be fewer than NO_MATCH tokens.
+ */
+BracketIndex index_brackets(const std::vector<Token>& tokens);
+
+/**
+ * Lexer storage reused across inputs.
+ *
+ * Each call overwrites the tokens of the previous one, keeping the memory:
+ * the token vector is reserved up front from the input size and never
+ * shrinks, so once it has seen a file about as big as the next one, lexing
+ * allocates nothing. The returned tokens stay valid until the next call.
+ */
+class LexContext {
+public:
+    const std::vector<Token>& lex(const char* first, const char* last, LexEngine engine = LexEngine::Handwritten);
+    const std::vector<Token>& lex_padded(const char* first, const char* last);
+
+    const std::vector<Token>& tokens() const { return m_tokens; }
+
+    /**
+     * Makes every call index the brackets of its tokens too, into brackets(),
+     * reusing that memory the same way.
+     */
+    void index_brackets() { m_index_brackets = true; }
+    bool indexes_brackets() const { return m_index_brackets; }
+    const BracketIndex& brackets() const { return m_brackets; }
+
+private:
+    std::vector<Token> m_tokens;
+    std::vector<uint64_t> m_scratch;  // per-engine working memory
+    bool m_index_brackets = false;
+    BracketIndex m_brackets;
+    std::vector<uint32_t> m_open;     // the stack of index_brackets
+};
+
+/**
+ * Source text owned together with the padding lex_padded needs.
+ */
+class PaddedSource {
+public:
+    PaddedSource() : PaddedSource(std::string()) {}
+    explicit PaddedSource(std::string text);
+
+    // Replaces the contents with the file at `path`; false if it can't be
+    // opened or read.
+    bool read_file(const std::string& path);
+
+    const char* begin() const { return m_text.data(); }
+    const char* end() const { return m_text.data() + m_size; }
+    size_t size() const { return m_size; }
+
+private:
+    std::string m_text;  // the source followed by LEX_PADDING NULs
+    size_t m_size;
+};
+
+// The name of a token type as the lexer prints it, e.g. "OpenParen".
+const char* token_type_name(TokenType type);
+
+// The token type printed as [first, last); unknown names map to Error.
+TokenType token_type_from_name(const char* first, const char* last);
 
 
 Token munch_token(const char* first, const char* last);
@@ -0,0 +1,291 @@
+#include <cstdint>
+#include <cstring>
+
+#include "lexer_structural.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * A two-stage lexer in the style of simdjson.
+ *
+ * Stage one classifies the whole input 64 bytes at a time into bitmaps, one
+ * bit per byte: whitespace, identifier characters, digits, newlines and
+ * stars. Stage two walks the tokens, using the bitmaps to find where runs end
+ * with a bit scan instead of a byte loop: whitespace runs, identifiers and
+ * numbers, and `//` comments (next newline) and block comments (next star).
+ * Only operators and error runs look at individual bytes.
+ *
+ * Token boundaries in Cflat depend on what came before (a digit run is a
+ * number only at a token start; comments swallow everything), so the token
+ * starts are found in stage two rather than all at once in stage one.
+ */
+
+namespace {
+
+// Views into one scratch vector, `words` 64-bit words each.
+struct Bitmaps {
+    uint64_t* space;
+    uint64_t* ident;  // [a-zA-Z0-9_]
+    uint64_t* digit;
+    uint64_t* newline;
+    uint64_t* star;
+    size_t words;
+};
+
+#ifdef __SSE2__
+
+// Bytes of `v` in [lo, hi]. Bytes >= 0x80 compare as negative, so they never
+// fall in an ASCII range.
+inline __m128i in_range(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+}
+
+inline uint64_t mask64(const __m128i (&m)[4]) {
+    return static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m[0])))
+         | static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m[1]))) << 16
+         | static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m[2]))) << 32
+         | static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(m[3]))) << 48;
+}
+
+void classify_block(const char* block, Bitmaps& maps, size_t word) {
+    __m128i space[4], ident[4], digit[4], newline[4], star[4];
+    for (int i = 0; i < 4; ++i) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        digit[i] = in_range(v, '0', '9');
+        ident[i] = _mm_or_si128(_mm_or_si128(in_range(lower, 'a', 'z'), digit[i]),
+                                _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        newline[i] = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        space[i] = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), in_range(v, '\t', '\r'));
+        star[i] = _mm_cmpeq_epi8(v, _mm_set1_epi8('*'));
+    }
+    maps.space[word] = mask64(space);
+    maps.ident[word] = mask64(ident);
+    maps.digit[word] = mask64(digit);
+    maps.newline[word] = mask64(newline);
+    maps.star[word] = mask64(star);
+}
+
+#else
+
+void classify_block(const char* block, Bitmaps& maps, size_t word) {
+    uint64_t space = 0, ident = 0, digit = 0, newline = 0, star = 0;
+    for (int i = 0; i < 64; ++i) {
+        unsigned char c = static_cast<unsigned char>(block[i]);
+        uint64_t bit = uint64_t(1) << i;
+        bool is_digit = c >= '0' && c <= '9';
+        bool is_alpha = (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+        if (c == ' ' || (c >= '\t' && c <= '\r')) space |= bit;
+        if (is_alpha || is_digit || c == '_') ident |= bit;
+        if (is_digit) digit |= bit;
+        if (c == '\n') newline |= bit;
+        if (c == '*') star |= bit;
+    }
+    maps.space[word] = space;
+    maps.ident[word] = ident;
+    maps.digit[word] = digit;
+    maps.newline[word] = newline;
+    maps.star[word] = star;
+}
+
+#endif
+
+// Stage one, into `storage`. The last partial block is classified from a
+// zero-filled copy, so bits past the end of the input are all clear.
+Bitmaps classify(const char* first, size_t size, std::vector<uint64_t>& storage) {
+    size_t words = (size + 63) / 64;
+    storage.resize(5 * words);
+    uint64_t* base = storage.data();
+    Bitmaps maps{base, base + words, base + 2 * words, base + 3 * words, base + 4 * words, words};
+    size_t full = size / 64;
+    for (size_t w = 0; w < full; ++w) {
+        classify_block(first + 64 * w, maps, w);
+    }
+    if (full < words) {
+        char tail[64] = {};
+        std::memcpy(tail, first + 64 * full, size - 64 * full);
+        classify_block(tail, maps, full);
+    }
+    return maps;
+}
+
+// The first set bit at or after `pos`, or `size` if none.
+size_t next_one(const uint64_t* bits, size_t words, size_t pos, size_t size) {
+    size_t word = pos / 64;
+    if (word >= words) return size;
+    uint64_t w = bits[word] & (~uint64_t(0) << (pos % 64));
+    while (w == 0) {
+        if (++word == words) return size;
+        w = bits[word];
+    }
+    size_t found = word * 64 + static_cast<size_t>(__builtin_ctzll(w));
+    return found < size ? found : size;
+}
+
+// The first clear bit at or after `pos`, or `size` if none.
+size_t next_zero(const uint64_t* bits, size_t words, size_t pos, size_t size) {
+    size_t word = pos / 64;
+    if (word >= words) return size;
+    uint64_t w = ~bits[word] & (~uint64_t(0) << (pos % 64));
+    while (w == 0) {
+        if (++word == words) return size;
+        w = ~bits[word];
+    }
+    size_t found = word * 64 + static_cast<size_t>(__builtin_ctzll(w));
+    return found < size ? found : size;
+}
+
+bool spelled(const char* p, const char* keyword, size_t n) {
+    return std::memcmp(p, keyword, n) == 0;
+}
+
+// Keywords by length, so each identifier is compared with at most four.
+TokenType keyword_or_id(const char* p, size_t n) {
+    switch (n) {
+        case 2:
+            if (spelled(p, "if", 2)) return TokenType::If;
+            if (spelled(p, "fn", 2)) return TokenType::Fn;
+            if (spelled(p, "or", 2)) return TokenType::Or;
+            break;
+        case 3:
+            if (spelled(p, "int", 3)) return TokenType::Int;
+            if (spelled(p, "nil", 3)) return TokenType::Nil;
+            if (spelled(p, "new", 3)) return TokenType::New;
+            if (spelled(p, "let", 3)) return TokenType::Let;
+            if (spelled(p, "and", 3)) return TokenType::And;
+            if (spelled(p, "not", 3)) return TokenType::Not;
+            break;
+        case 4:
+            if (spelled(p, "else", 4)) return TokenType::Else;
+            break;
+        case 5:
+            if (spelled(p, "break", 5)) return TokenType::Break;
+            if (spelled(p, "while", 5)) return TokenType::While;
+            break;
+        case 6:
+            if (spelled(p, "struct", 6)) return TokenType::Struct;
+            if (spelled(p, "return", 6)) return TokenType::Return;
+            if (spelled(p, "extern", 6)) return TokenType::Extern;
+            break;
+        case 8:
+            if (spelled(p, "continue", 8)) return TokenType::Continue;
+            break;
+    }
+    return TokenType::Id;
+}
+
+bool is_alpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// The operator at `p`, or Error; `length` is set to its length.
+TokenType operator_at(const char* p, const char* last, size_t& length) {
+    length = 2;
+    if (last - p >= 2 && p[1] == '=') {
+        switch (p[0]) {
+            case '!': return TokenType::NotEq;
+            case '<': return TokenType::Lte;
+            case '>': return TokenType::Gte;
+            case '=': return TokenType::Equal;
+        }
+    }
+    if (last - p >= 2 && p[0] == '-' && p[1] == '>') return TokenType::Arrow;
+    length = 1;
+    switch (p[0]) {
+        case ':': return TokenType::Colon;
+        case ';': return TokenType::Semicolon;
+        case ',': return TokenType::Comma;
+        case '&': return TokenType::Ampersand;
+        case '+': return TokenType::Plus;
+        case '-': return TokenType::Dash;
+        case '*': return TokenType::Star;
+        case '/': return TokenType::Slash;
+        case '<': return TokenType::Lt;
+        case '>': return TokenType::Gt;
+        case '.': return TokenType::Dot;
+        case '=': return TokenType::Gets;
+        case '(': return TokenType::OpenParen;
+        case ')': return TokenType::CloseParen;
+        case '[': return TokenType::OpenBracket;
+        case ']': return TokenType::CloseBracket;
+        case '{': return TokenType::OpenBrace;
+        case '}': return TokenType::CloseBrace;
+        case '?': return TokenType::QuestionMark;
+    }
+    return TokenType::Error;
+}
+
+// True if a token starts at `p`; this ends an error run.
+bool starts_token(const char* p, const char* last) {
+    if (is_alpha(*p) || is_digit(*p)) return true;
+    size_t length;
+    return operator_at(p, last, length) != TokenType::Error;
+}
+
+} // namespace
+
+void lex_structural(const char* first, const char* last, std::vector<Token>& tokens, std::vector<uint64_t>& scratch) {
+    const size_t size = static_cast<size_t>(last - first);
+    const Bitmaps maps = classify(first, size, scratch);
+
+    size_t pos = 0;
+    for (;;) {
+        pos = next_zero(maps.space, maps.words, pos, size);
+        if (pos >= size) break;
+        const char* p = first + pos;
+
+        if (p[0] == '/' && pos + 1 < size && (p[1] == '/' || p[1] == '*')) {
+            size_t end = size;
+            bool closed = false;
+            if (p[1] == '/') {
+                size_t newline = next_one(maps.newline, maps.words, pos + 2, size);
+                closed = newline < size;
+                end = newline + 1;
+            } else {
+                for (size_t star = next_one(maps.star, maps.words, pos + 2, size); star + 1 < size;
+                     star = next_one(maps.star, maps.words, star + 1, size)) {
+                    if (first[star + 1] == '/') {
+                        closed = true;
+                        end = star + 2;
+                        break;
+                    }
+                }
+            }
+            if (!closed) {
+                // Unterminated: an error token running to the end.
+                tokens.push_back(Token{TokenType::Error, p, last});
+                break;
+            }
+            pos = end;
+            continue;
+        }
+
+        size_t end;
+        TokenType type;
+        if (is_alpha(p[0])) {
+            end = next_zero(maps.ident, maps.words, pos + 1, size);
+            type = keyword_or_id(p, end - pos);
+        } else if (is_digit(p[0])) {
+            end = next_zero(maps.digit, maps.words, pos + 1, size);
+            type = TokenType::Num;
+        } else {
+            size_t length;
+            type = operator_at(p, last, length);
+            end = pos + length;
+            if (type == TokenType::Error) {
+                // Always at least one byte, then anything up to the next token.
+                end = pos + 1;
+                while (end < size && !starts_token(first + end, last)) ++end;
+            }
+        }
+        tokens.push_back(Token{type, p, first + end, type == TokenType::Num ? num_value(p, first + end) : 0});
+        pos = end;
+    }
+}
@@ -0,0 +1,15 @@
+#ifndef LEXER_STRUCTURAL_HPP_
+#define LEXER_STRUCTURAL_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "lexer.hpp"
+
+/**
+ * The two-stage engine behind lex(..., LexEngine::Structural). Appends to
+ * `tokens`; `scratch` holds the bitmaps and may be reused between calls.
+ */
+void lex_structural(const char* first, const char* last, std::vector<Token>& tokens, std::vector<uint64_t>& scratch);
+
+#endif
@@ -0,0 +1,362 @@
+#include <cstddef>
+#include <cstdint>
+
+#include "lexer_table.hpp"
+
+/**
+ * A table-driven lexer.
+ *
+ * Every byte is first mapped to a character class, then one lookup in the
+ * transition table gives the next state. Keywords and operators are a trie
+ * of states built from TOKEN_SPELLINGS; identifiers, numbers, whitespace,
+ * comments and error runs are a handful of fixed states. Reaching a final
+ * state ends the token: the final state says what to emit (or that the bytes
+ * were skipped) and how many bytes of lookahead to give back. End of input is
+ * one more character class, so every token ends on a transition.
+ *
+ * The whole table is computed at compile time.
+ */
+
+namespace {
+
+constexpr int MAX_CLASSES = 64;
+constexpr int MAX_STATES = 256;
+constexpr int MAX_NODES = 128;
+constexpr int NONE = -1;
+
+/** What a final state does. */
+struct Action {
+    TokenType type = TokenType::Error;
+    uint8_t retract = 0;  // lookahead bytes that belong to the next token
+    bool skip = false;    // whitespace or a comment: emit nothing
+};
+
+struct Table {
+    uint8_t byte_class[256] = {};
+    uint8_t eof_class = 0;
+    uint8_t start = 0;
+    uint8_t first_final = 0;  // states from here on are final
+    uint8_t next[MAX_STATES][MAX_CLASSES] = {};
+    Action actions[MAX_STATES] = {};  // indexed by state - first_final
+};
+
+constexpr bool is_alpha(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool is_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool is_space(int c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/**
+ * Builds the Table. Only constant expressions are used, so the result can
+ * initialise a constexpr variable.
+ */
+class Builder {
+public:
+    constexpr Table build() {
+        assign_classes();
+        build_trie();
+        number_states();
+        fill_start();
+        fill_trie();
+        fill_fixed();
+        return m_table;
+    }
+
+private:
+    Table m_table;
+
+    // Character classes: a representative byte for each, or NONE for end of input.
+    int m_rep[MAX_CLASSES] = {};
+    int m_class_count = 0;
+
+    // The spelling trie; node 0 is the root.
+    struct Node {
+        int child[MAX_CLASSES] = {};  // node index, or 0 for none
+        int type = NONE;             // TokenType if a spelling ends here
+        int state = NONE;            // the state for this node, if it needs one
+    };
+    Node m_nodes[MAX_NODES] = {};
+    int m_node_count = 1;
+
+    // Fixed states.
+    int m_ws = 0, m_id = 0, m_num = 0, m_err = 0;
+    int m_line_comment = 0, m_block_comment = 0, m_block_star = 0;
+    int m_pending[MAX_CLASSES] = {};  // error run that may end before a two-byte operator
+
+    int m_state_count = 0;
+    int m_final_count = 0;
+
+    constexpr int add_class(int rep) {
+        if (m_class_count >= MAX_CLASSES) throw "too many character classes";
+        m_rep[m_class_count] = rep;
+        return m_class_count++;
+    }
+
+    constexpr int cls(char c) const {
+        return m_table.byte_class[static_cast<unsigned char>(c)];
+    }
+
+    // Bytes in spellings get their own classes. Everything else falls into
+    // one class per behaviour: other letters, digits, '_', '\n', other
+    // whitespace, and everything else.
+    constexpr void assign_classes() {
+        int other = add_class(0);
+        for (int b = 0; b < 256; ++b) m_table.byte_class[b] = static_cast<uint8_t>(other);
+
+        bool seen[256] = {};
+        for (const TokenSpelling& spelling : TOKEN_SPELLINGS) {
+            for (const char* p = spelling.text; *p; ++p) {
+                unsigned char b = static_cast<unsigned char>(*p);
+                if (!seen[b]) {
+                    seen[b] = true;
+                    m_table.byte_class[b] = static_cast<uint8_t>(add_class(b));
+                }
+            }
+        }
+        int letter = NONE, digit = NONE, space = NONE;
+        for (int b = 0; b < 256; ++b) {
+            if (seen[b]) continue;
+            int c = other;
+            if (is_alpha(b)) {
+                c = letter == NONE ? (letter = add_class(b)) : letter;
+            } else if (is_digit(b)) {
+                c = digit == NONE ? (digit = add_class(b)) : digit;
+            } else if (b == '_' || b == '\n' || b == '/' || b == '*') {
+                c = add_class(b);
+            } else if (is_space(b)) {
+                c = space == NONE ? (space = add_class(b)) : space;
+            }
+            m_table.byte_class[b] = static_cast<uint8_t>(c);
+        }
+        m_table.eof_class = static_cast<uint8_t>(add_class(NONE));
+    }
+
+    constexpr void build_trie() {
+        for (const TokenSpelling& spelling : TOKEN_SPELLINGS) {
+            int node = 0;
+            for (const char* p = spelling.text; *p; ++p) {
+                int c = cls(*p);
+                if (m_nodes[node].child[c] == 0) {
+                    if (m_node_count >= MAX_NODES) throw "too many trie nodes";
+                    m_nodes[node].child[c] = m_node_count++;
+                }
+                node = m_nodes[node].child[c];
+            }
+            m_nodes[node].type = static_cast<int>(spelling.type);
+        }
+    }
+
+    constexpr bool has_children(int node) const {
+        for (int c = 0; c < m_class_count; ++c) {
+            if (m_nodes[node].child[c] != 0) return true;
+        }
+        return false;
+    }
+
+    constexpr bool alpha_class(int c) const { return m_rep[c] != NONE && is_alpha(m_rep[c]); }
+    constexpr bool digit_class(int c) const { return m_rep[c] != NONE && is_digit(m_rep[c]); }
+    constexpr bool space_class(int c) const { return m_rep[c] != NONE && is_space(m_rep[c]); }
+    constexpr bool ident_class(int c) const { return alpha_class(c) || digit_class(c) || m_rep[c] == '_'; }
+
+    constexpr int new_state() {
+        if (m_state_count >= MAX_STATES) throw "too many states";
+        return m_state_count++;
+    }
+
+    // Operator trie nodes without children end their token on the byte that
+    // reaches them, so they need no state of their own. '/' is the exception:
+    // it may start a comment.
+    constexpr void number_states() {
+        m_table.start = static_cast<uint8_t>(new_state());
+        m_nodes[0].state = m_table.start;
+        int slash = m_nodes[0].child[cls('/')];
+        for (int node = 1; node < m_node_count; ++node) {
+            if (has_children(node) || is_keyword_node(node) || node == slash) {
+                m_nodes[node].state = new_state();
+            }
+        }
+        m_ws = new_state();
+        m_id = new_state();
+        m_num = new_state();
+        m_err = new_state();
+        m_line_comment = new_state();
+        m_block_comment = new_state();
+        m_block_star = new_state();
+        for (int c = 0; c < m_class_count; ++c) {
+            int node = m_nodes[0].child[c];
+            m_pending[c] = NONE;
+            if (node != 0 && !alpha_class(c) && m_nodes[node].type == NONE) {
+                m_pending[c] = new_state();
+            }
+        }
+        m_table.first_final = static_cast<uint8_t>(m_state_count);
+    }
+
+    // True if `node` lies on a keyword path, i.e. its spelling starts with a letter.
+    constexpr bool is_keyword_node(int node) const {
+        for (int c = 0; c < m_class_count; ++c) {
+            int child = m_nodes[0].child[c];
+            if (child != 0 && alpha_class(c) && in_subtree(child, node)) return true;
+        }
+        return false;
+    }
+
+    constexpr bool in_subtree(int root, int node) const {
+        if (root == node) return true;
+        for (int c = 0; c < m_class_count; ++c) {
+            int child = m_nodes[root].child[c];
+            if (child != 0 && in_subtree(child, node)) return true;
+        }
+        return false;
+    }
+
+    // The final state for `action`, allocated on first use.
+    constexpr int final_state(TokenType type, int retract, bool skip = false) {
+        for (int i = 0; i < m_final_count; ++i) {
+            const Action& a = m_table.actions[i];
+            if (a.type == type && a.retract == retract && a.skip == skip) return m_table.first_final + i;
+        }
+        if (m_table.first_final + m_final_count >= MAX_STATES) throw "too many states";
+        m_table.actions[m_final_count] = Action{type, static_cast<uint8_t>(retract), skip};
+        return m_table.first_final + m_final_count++;
+    }
+
+    constexpr void set(int state, int c, int target) {
+        m_table.next[state][c] = static_cast<uint8_t>(target);
+    }
+
+    // True if a byte of class `c` starts a token on its own, which ends an
+    // error run: a letter, a digit or a one-byte operator.
+    constexpr bool starts_token(int c) const {
+        if (alpha_class(c) || digit_class(c)) return true;
+        int node = m_nodes[0].child[c];
+        return node != 0 && m_nodes[node].type != NONE;
+    }
+
+    // Where an error run goes on a byte of class `c`.
+    constexpr int error_next(int c) {
+        if (c == m_table.eof_class || starts_token(c)) return final_state(TokenType::Error, 1);
+        if (m_pending[c] != NONE) return m_pending[c];
+        return m_err;
+    }
+
+    // Where trie node `node` goes on a byte of class `c`.
+    constexpr int trie_next(int node, int c) {
+        int child = m_nodes[node].child[c];
+        if (m_nodes[child].state != NONE) return m_nodes[child].state;
+        return final_state(static_cast<TokenType>(m_nodes[child].type), 0);
+    }
+
+    constexpr void fill_start() {
+        for (int c = 0; c < m_class_count; ++c) {
+            int target = m_err;
+            if (c == m_table.eof_class) {
+                target = final_state(TokenType::Error, 1, true);
+            } else if (space_class(c)) {
+                target = m_ws;
+            } else if (m_nodes[0].child[c] != 0) {
+                target = trie_next(0, c);
+            } else if (alpha_class(c)) {
+                target = m_id;
+            } else if (digit_class(c)) {
+                target = m_num;
+            }
+            set(m_table.start, c, target);
+        }
+    }
+
+    constexpr void fill_trie() {
+        for (int node = 1; node < m_node_count; ++node) {
+            int state = m_nodes[node].state;
+            if (state == NONE) continue;
+            int type = m_nodes[node].type;
+            bool keyword = is_keyword_node(node);
+            for (int c = 0; c < m_class_count; ++c) {
+                int target = 0;
+                if (m_nodes[node].child[c] != 0) {
+                    target = trie_next(node, c);
+                } else if (keyword) {
+                    // Keywords are identifiers that happen to be spelled right.
+                    target = ident_class(c) ? m_id
+                           : final_state(type == NONE ? TokenType::Id : static_cast<TokenType>(type), 1);
+                } else if (type != NONE) {
+                    target = final_state(static_cast<TokenType>(type), 1);
+                } else {
+                    // A lone first byte of a two-byte operator is an error.
+                    target = error_next(c);
+                }
+                set(state, c, target);
+            }
+        }
+        // "//" and "/*" start comments rather than two Slash tokens.
+        int slash = m_nodes[m_nodes[0].child[cls('/')]].state;
+        set(slash, cls('/'), m_line_comment);
+        set(slash, cls('*'), m_block_comment);
+    }
+
+    constexpr void fill_fixed() {
+        int eof = m_table.eof_class;
+        for (int c = 0; c < m_class_count; ++c) {
+            set(m_ws, c, space_class(c) ? m_ws : final_state(TokenType::Error, 1, true));
+            set(m_id, c, ident_class(c) ? m_id : final_state(TokenType::Id, 1));
+            set(m_num, c, digit_class(c) ? m_num : final_state(TokenType::Num, 1));
+            set(m_err, c, error_next(c));
+
+            // An unterminated comment is an error token running to the end.
+            set(m_line_comment, c, c == eof ? final_state(TokenType::Error, 1)
+                                 : m_rep[c] == '\n' ? final_state(TokenType::Error, 0, true)
+                                 : m_line_comment);
+            set(m_block_comment, c, c == eof ? final_state(TokenType::Error, 1)
+                                  : m_rep[c] == '*' ? m_block_star
+                                  : m_block_comment);
+            set(m_block_star, c, c == eof ? final_state(TokenType::Error, 1)
+                               : m_rep[c] == '/' ? final_state(TokenType::Error, 0, true)
+                               : m_rep[c] == '*' ? m_block_star
+                               : m_block_comment);
+        }
+        // An error run followed by the first byte of a two-byte operator
+        // ends before that byte if the operator is complete.
+        for (int first = 0; first < m_class_count; ++first) {
+            if (m_pending[first] == NONE) continue;
+            int node = m_nodes[0].child[first];
+            for (int c = 0; c < m_class_count; ++c) {
+                set(m_pending[first], c, m_nodes[node].child[c] != 0 ? final_state(TokenType::Error, 2)
+                                                                    : error_next(c));
+            }
+        }
+    }
+};
+
+constexpr Table TABLE = Builder().build();
+
+} // namespace
+
+void lex_table(const char* first, const char* last, std::vector<Token>& tokens) {
+
+    const size_t size = static_cast<size_t>(last - first);
+    size_t pos = 0;
+    while (pos < size) {
+        size_t start = pos;
+        unsigned state = TABLE.start;
+        do {
+            unsigned c = pos < size ? TABLE.byte_class[static_cast<unsigned char>(first[pos])] : TABLE.eof_class;
+            state = TABLE.next[state][c];
+            ++pos;
+        } while (state < TABLE.first_final);
+
+        const Action& action = TABLE.actions[state - TABLE.first_final];
+        pos -= action.retract;
+        if (!action.skip) {
+            tokens.push_back(Token{action.type, first + start, first + pos});
+            if (action.type == TokenType::Num) {
+                tokens.back().value = num_value(first + start, first + pos);
+            }
+        }
+    }
+}
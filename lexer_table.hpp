@@ -0,0 +1,13 @@
+#ifndef LEXER_TABLE_HPP_
+#define LEXER_TABLE_HPP_
+
+#include <vector>
+
+#include "lexer.hpp"
+
+/**
+ * The table-driven engine behind lex(..., LexEngine::Table). Appends to `tokens`.
+ */
+void lex_table(const char* first, const char* last, std::vector<Token>& tokens);
+
+#endif
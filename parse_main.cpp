@@ -1,68 +1,413 @@
 #include "parser.hpp"
+#include "syntax_check.hpp"
+#include "batch.hpp"
+#include "ast_snapshot.hpp"
+#include "parse_output.hpp"
+#include "pipeline.hpp"
+#include "token_file.hpp"
+#include "result_cache.hpp"
+#include "stats.hpp"
+#include "watch.hpp"
 #include <iostream>
 #include <fstream>
+#include <functional>
 #include <sstream>
 #include <vector>
 #include <string>
 
-// Helper to split a string by a delimiter
-std::vector<std::string> split(const std::string& s, char delimiter) {
-    std::vector<std::string> parts;
-    std::string part;
-    std::istringstream tokenStream(s);
-    while (std::getline(tokenStream, part, delimiter)) {
-        parts.push_back(part);
+// Parses one line of lexer output and prints the AST to `out`; diagnostics go
+// to `err`. Returns the AST, or null if there is none.
+static std::unique_ptr<Program> parse_line(const std::string& filename, const std::string& line,
+                                           const ParseOptions& options, std::ostream& out, std::ostream& err,
+                                           Stats& stats, bool show_stats) {
+    stats.begin("tokenize");
+    std::vector<Token> tokens = tokenize_input(line);
+    if (show_stats) {
+        stats.input_bytes = line.size();
+        stats.tokens = tokens.size();
+        for (const Token& token : tokens) {
+            ++stats.token_counts[token_type_name(token.token_type)];
+        }
     }
-    return parts;
+
+    return parse_and_print(std::move(tokens), line.data(), line.data() + line.size(), filename,
+                           options, out, err, stats, show_stats);
 }
 
-// Helper to convert the string tokens from the file into Token structs
-std::vector<Token> tokenize_input(const std::string& line) {
-    std::vector<Token> tokens;
-    std::vector<std::string> string_tokens = split(line, ' ');
-    for (size_t i = 0; i < string_tokens.size(); ++i) {
-        const auto& str_tok = string_tokens[i];
-        if (str_tok.empty()) continue;
-
-        size_t open_paren = str_tok.find('(');
-        if (open_paren != std::string::npos) {
-            // Token with value, e.g., Id(x) or Num(42)
-            std::string type = str_tok.substr(0, open_paren);
-            std::string value = str_tok.substr(open_paren + 1, str_tok.length() - open_paren - 2);
-            tokens.push_back({type, value, i});
-        } else {
-            tokens.push_back({str_tok, "", i});
-        }
+// Reads the first line of `filename` into `line`; false if it can't be opened.
+static bool read_line(const std::string& filename, std::string& line, std::ostream& err) {
+    std::ifstream file(filename);
+    if (!file) {
+        err << "Error: Could not open file " << filename << std::endl;
+        return false;
     }
-    return tokens;
+    line.clear();
+    std::getline(file, line);
+    return true;
 }
 
+// Parses one file and prints its AST to `out`; diagnostics go to `err`. Goes
+// through `cache` if there is one, unless a snapshot is to be written.
+// Returns false if the file couldn't be read or the snapshot couldn't be
+// written. A parse error is part of the output, not a failure.
+static bool parse_file(const std::string& filename, const ParseOptions& options, ResultCache* cache,
+                       std::ostream& out, std::ostream& err, Stats& stats, bool show_stats) {
+    stats.begin("read");
+    std::string line;
+    if (!read_line(filename, line, err)) return false;
+    if (!cache || !options.write_snapshot_path.empty()) {
+        std::unique_ptr<Program> ast = parse_line(filename, line, options, out, err, stats, show_stats);
+        return write_requested_snapshot(ast.get(), options, err);
+    }
+    std::string variant = "parse";
+    if (options.fold) variant += " --fold";
+    if (options.show_locations) variant += " --locations " + filename;
+    cache->run(ResultCache::key(line.data(), line.data() + line.size(), variant), line.size(), out, err,
+               [&](std::ostream& fresh_out, std::ostream& fresh_err) {
+        parse_line(filename, line, options, fresh_out, fresh_err, stats, show_stats);
+    });
+    return true;
+}
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        std::cerr << "Usage: parse <filename>" << std::endl;
-        return 1;
+// Parses Cflat source instead of lexer output, reading, lexing and parsing it
+// at the same time on three threads (see pipeline.hpp). The output is what
+// `lex` and then `parse` would print. Returns false if the file couldn't be
+// opened or the snapshot couldn't be written.
+static bool parse_source_pipelined(const std::string& filename, const ParseOptions& options, std::ostream& out,
+                                   std::ostream& err, Stats& stats, bool show_stats) {
+    std::unique_ptr<Pipeline> pipeline;
+    try {
+        pipeline = std::make_unique<Pipeline>(filename);
+    } catch (const std::runtime_error& e) {
+        err << e.what() << std::endl;
+        return false;
     }
+    BasicParser<FeedSource> parser(*pipeline);
+    std::unique_ptr<Program> ast = parse_and_print([&] { return parser.parse(); }, pipeline->begin(), pipeline->end(),
+                                                   filename, options, out, err, stats, show_stats);
+    if (show_stats) {
+        stats.input_bytes = pipeline->end() - pipeline->begin();
+        stats.tokens = parser.tokens_read();
+    }
+    return write_requested_snapshot(ast.get(), options, err);
+}
 
-    std::ifstream file(argv[1]);
-    if (!file) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
-        return 1;
+// Parses Cflat source like parse_source_pipelined, on one thread: the lexer
+// is a coroutine the parser pulls tokens from, so only two tokens are ever
+// held. Returns false if the file couldn't be opened or the snapshot couldn't
+// be written.
+static bool parse_source_lazily(const std::string& filename, const ParseOptions& options, std::ostream& out,
+                                std::ostream& err, Stats& stats, bool show_stats) {
+    stats.begin("read");
+    PaddedSource source;
+    if (!source.read_file(filename)) {
+        err << "Error: Could not open file " << filename << std::endl;
+        return false;
     }
+    BasicParser<LazyLexSource> parser(lex_lazily(source.begin(), source.end()));
+    std::unique_ptr<Program> ast = parse_and_print([&] { return parser.parse(); }, source.begin(), source.end(), filename,
+                                                   options, out, err, stats, show_stats);
+    if (show_stats) {
+        stats.input_bytes = source.size();
+        stats.tokens = parser.tokens_read();
+    }
+    return write_requested_snapshot(ast.get(), options, err);
+}
 
+// Parses the tokens in a token file written by `lex --write-tokens`, mapped
+// and read in place (token_file.hpp). Returns false if it couldn't be mapped
+// or the snapshot couldn't be written.
+static bool parse_token_file(const std::string& path, const ParseOptions& options, std::ostream& out,
+                             std::ostream& err, Stats& stats, bool show_stats) {
+    stats.begin("map");
+    std::unique_ptr<token_file::TokenFile> file;
+    try {
+        file = std::make_unique<token_file::TokenFile>(path);
+    } catch (const std::runtime_error& e) {
+        stats.end();
+        err << e.what() << std::endl;
+        return false;
+    }
+    BasicParser<MappedSource> parser(*file);
+    std::unique_ptr<Program> ast = parse_and_print([&] { return parser.parse(); }, file->source_begin(),
+                                                   file->source_end(), path, options, out, err, stats, show_stats);
+    if (show_stats) {
+        stats.input_bytes = file->source_end() - file->source_begin();
+        stats.tokens = file->size();
+    }
+    return write_requested_snapshot(ast.get(), options, err);
+}
+
+// What running `f` over some tokens comes to: "valid", or the error it
+// threw with the index, type and text of the token it is about.
+static std::string outcome(const std::function<void()>& f) {
+    try {
+        f();
+        return "valid";
+    } catch (const ParseError& e) {
+        return std::string(e.what()) + " (token " + std::to_string(e.token) + ", " + token_type_name(e.at.token_type)
+               + " `" + std::string(e.at.first, e.at.last) + "`)";
+    } catch (const std::runtime_error& e) {
+        return e.what();
+    }
+}
+
+// For --check --verify: checks and fully parses tokens from `make_source`,
+// and returns false, saying how on `err`, unless both find a program or
+// both throw the same message about the same token.
+template <typename MakeSource>
+static bool check_agrees(MakeSource make_source, const std::string& filename, std::ostream& err) {
+    std::string checked = outcome([&] { BasicSyntaxChecker(make_source()).check(); });
+    std::string parsed = outcome([&] { BasicParser(make_source()).parse(); });
+    if (checked == parsed) return true;
+    err << filename << ": the checker and the parser disagree\n  check: " << checked << "\n  parse: " << parsed
+        << std::endl;
+    return false;
+}
+
+// Checks that a file parses without building its AST (syntax_check.hpp),
+// printing nothing if it does and the parse error if not. The file is Cflat
+// source, lexed lazily as the checker reads it, if `source` is set, and
+// lexer output otherwise. Returns false if it couldn't be read or doesn't
+// parse, so a batch of files exits with 1 if any of them is wrong. With
+// `verify`, the file is parsed in full as well, and it returns false only
+// if the two disagree, so a corpus of invalid files can be run through it.
+static bool check_file(const std::string& filename, bool source, bool verify, const ParseOptions& options,
+                       std::ostream& out, std::ostream& err, Stats& stats, bool show_stats) {
+    stats.begin("read");
+    if (source) {
+        PaddedSource text;
+        if (!text.read_file(filename)) {
+            err << "Error: Could not open file " << filename << std::endl;
+            return false;
+        }
+        BasicSyntaxChecker<LazyLexSource> checker(lex_lazily(text.begin(), text.end()));
+        bool valid = check_and_print([&] { checker.check(); }, text.begin(), text.end(), filename, options, out, err, stats);
+        if (show_stats) {
+            stats.input_bytes = text.size();
+            stats.tokens = checker.tokens_read();
+        }
+        if (verify) return check_agrees([&] { return LazyLexSource(lex_lazily(text.begin(), text.end())); }, filename, err);
+        return valid;
+    }
     std::string line;
-    std::getline(file, line);
+    if (!read_line(filename, line, err)) return false;
+    stats.begin("tokenize");
+    SyntaxChecker checker(tokenize_input(line));
+    bool valid = check_and_print([&] { checker.check(); }, line.data(), line.data() + line.size(), filename, options,
+                                 out, err, stats);
+    if (show_stats) {
+        stats.input_bytes = line.size();
+        stats.tokens = checker.tokens_read();
+    }
+    if (verify) return check_agrees([&] { return VectorSource(tokenize_input(line)); }, filename, err);
+    return valid;
+}
 
-    std::vector<Token> tokens = tokenize_input(line);
+// Each file's input line and AST are kept from one save to the next, so a
+// save that leaves the input as it was is skipped without parsing.
+struct WatchedFile {
+    bool parsed = false;
+    std::string line;
+    std::unique_ptr<Program> ast;
+};
 
+static int watch_files(const std::vector<std::string>& filenames, const ParseOptions& options) {
+    std::vector<WatchedFile> files(filenames.size());
     try {
-        Parser parser(tokens);
-        std::unique_ptr<Program> ast = parser.parse();
-        ast->print(std::cout);
-        std::cout << std::endl;
+        run_watch(filenames, std::cout, std::cerr, [&](size_t index, std::ostream& out, std::ostream& err) {
+            WatchedFile& file = files[index];
+            std::string line;
+            if (!read_line(filenames[index], line, err)) {
+                file = WatchedFile();
+                return true;
+            }
+            if (file.parsed && line == file.line) return false;
+            Stats stats;
+            file.line = std::move(line);
+            file.ast = parse_line(filenames[index], file.line, options, out, err, stats, false);
+            file.parsed = true;
+            return true;
+        });
     } catch (const std::runtime_error& e) {
-        std::cout << e.what() << std::endl;
+        std::cerr << e.what() << std::endl;
+    }
+    return 1;
+}
+
+static void usage() {
+    std::cerr << "Usage: parse [--stats] [--perf] [--fold] [--locations] [--write-snapshot <path>] <filename>" << std::endl;
+    std::cerr << "       parse [--fold] [--locations] [--jobs <n>] [--out-dir <dir>] [--files-from <list>] <filename>..." << std::endl;
+    std::cerr << "       parse --watch [--fold] [--locations] <filename>..." << std::endl;
+    std::cerr << "       either of the first two with [--cache <dir> [--cache-size <MB>] [--cache-stats]]" << std::endl;
+    std::cerr << "       parse --pipeline [--stats] [--fold] [--locations] [--write-snapshot <path>] <source-file>" << std::endl;
+    std::cerr << "       parse --lazy-lex [--stats] [--perf] [--fold] [--locations] [--write-snapshot <path>] <source-file>" << std::endl;
+    std::cerr << "       parse --read-tokens [--stats] [--perf] [--fold] [--locations] [--write-snapshot <path>] <token-file>" << std::endl;
+    std::cerr << "       parse --check [--lazy-lex] [--verify] [--stats] [--perf] [--locations] [--jobs <n>] [--files-from <list>] <filename>..." << std::endl;
+    std::cerr << "       parse --read-snapshot <path>" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    ParseOptions options;
+    std::string read_snapshot_path;
+    std::vector<std::string> filenames;
+    std::string files_from;
+    std::string out_dir;
+    size_t jobs = 0;
+    bool watch = false;
+    bool pipelined = false;
+    bool lazy_lex = false;
+    bool read_tokens = false;
+    bool check = false;
+    bool verify = false;
+    std::string cache_dir;
+    uint64_t cache_size = uint64_t(256) << 20;
+    bool show_cache_stats = false;
+    bool show_stats = false;
+    bool show_perf = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--fold") {
+            options.fold = true;
+        } else if (arg == "--locations") {
+            options.show_locations = true;
+        } else if (arg == "--watch") {
+            watch = true;
+        } else if (arg == "--pipeline") {
+            pipelined = true;
+        } else if (arg == "--lazy-lex") {
+            lazy_lex = true;
+        } else if (arg == "--read-tokens") {
+            read_tokens = true;
+        } else if (arg == "--check") {
+            check = true;
+        } else if (arg == "--verify") {
+            verify = true;
+        } else if (arg == "--stats") {
+            show_stats = true;
+        } else if (arg == "--perf") {
+            show_stats = show_perf = true;
+        } else if (arg == "--write-snapshot" && i + 1 < argc) {
+            options.write_snapshot_path = argv[++i];
+        } else if (arg == "--read-snapshot" && i + 1 < argc) {
+            read_snapshot_path = argv[++i];
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            if (!parse_jobs(argv[++i], jobs)) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--out-dir" && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (arg == "--files-from" && i + 1 < argc) {
+            files_from = argv[++i];
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            if (!parse_cache_size(argv[++i], cache_size)) {
+                usage();
+                return 1;
+            }
+        } else if (arg == "--cache-stats") {
+            show_cache_stats = true;
+        } else {
+            filenames.push_back(arg);
+        }
+    }
+
+    // A snapshot already holds a parsed program: map it and print it directly.
+    if (!read_snapshot_path.empty()) {
+        if (!filenames.empty()) {
+            usage();
+            return 1;
+        }
+        try {
+            snapshot::Snapshot snap(read_snapshot_path);
+            snap.root().print(std::cout);
+            std::cout << std::endl;
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
     }
 
-    return 0;
-}
\ No newline at end of file
+    if (!files_from.empty()) {
+        try {
+            std::vector<std::string> listed = read_file_list(files_from);
+            filenames.insert(filenames.end(), listed.begin(), listed.end());
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    bool batch = filenames.size() > 1 || !files_from.empty() || !out_dir.empty() || jobs != 0;
+    bool single_only = show_stats || !options.write_snapshot_path.empty();
+    bool cache_options = !cache_dir.empty() || show_cache_stats;
+    if (filenames.empty() || (batch && single_only)
+            || (watch && (single_only || !out_dir.empty() || jobs != 0 || cache_options))
+            || (show_cache_stats && cache_dir.empty())
+            || ((pipelined || lazy_lex || read_tokens) && (batch || watch || cache_options) && !check)
+            || (pipelined + lazy_lex + read_tokens > 1)
+            || (pipelined && show_perf)
+            || (verify && !check)
+            || (check && (options.fold || !options.write_snapshot_path.empty() || !out_dir.empty() || watch
+                          || cache_options || pipelined || read_tokens))) {
+        usage();
+        return 1;
+    }
+
+    if (watch) {
+        return watch_files(filenames, options);
+    }
+
+    std::unique_ptr<ResultCache> cache;
+    if (!cache_dir.empty()) {
+        try {
+            cache = std::make_unique<ResultCache>(cache_dir, cache_size);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    int status = 0;
+    if (check && batch) {
+        status = run_batch_files(filenames, jobs, out_dir, "", std::cout, std::cerr,
+                                 [&](const std::string& path, size_t, std::ostream& out, std::ostream& err) {
+            Stats stats;
+            return check_file(path, lazy_lex, verify, options, out, err, stats, false);
+        });
+    } else if (batch) {
+        status = run_batch_files(filenames, jobs, out_dir, ".ast", std::cout, std::cerr,
+                                 [&](const std::string& path, size_t, std::ostream& out, std::ostream& err) {
+            Stats stats;
+            return parse_file(path, options, cache.get(), out, err, stats, false);
+        });
+    } else {
+        Stats stats;
+        if (show_perf) stats.enable_perf();
+        bool parsed;
+        if (check) {
+            parsed = check_file(filenames[0], lazy_lex, verify, options, std::cout, std::cerr, stats, show_stats);
+        } else if (pipelined) {
+            parsed = parse_source_pipelined(filenames[0], options, std::cout, std::cerr, stats, show_stats);
+        } else if (lazy_lex) {
+            parsed = parse_source_lazily(filenames[0], options, std::cout, std::cerr, stats, show_stats);
+        } else if (read_tokens) {
+            parsed = parse_token_file(filenames[0], options, std::cout, std::cerr, stats, show_stats);
+        } else {
+            parsed = parse_file(filenames[0], options, cache.get(), std::cout, std::cerr, stats, show_stats);
+        }
+        if (!parsed) {
+            status = 1;
+        } else if (show_stats) {
+            stats.report(std::cerr);
+        }
+    }
+
+    if (cache) {
+        cache->evict();
+        if (show_cache_stats) cache->report(std::cerr);
+    }
+    return status;
+}
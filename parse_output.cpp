@@ -0,0 +1,84 @@
+#include "parse_output.hpp"
+#include "ast_snapshot.hpp"
+#include "fold.hpp"
+#include "parser.hpp"
+#include "source_location.hpp"
+
+#include <algorithm>
+
+// Prints `e` in place of the AST, and with --locations where it is to `err`.
+static void print_parse_error(const ParseError& e, const char* first, const char* last, const std::string& path,
+                              const ParseOptions& options, std::ostream& out, std::ostream& err) {
+    out << e.what() << std::endl;
+    if (options.show_locations && e.at.first) {
+        // Only the text up to the token is needed, and with a Pipeline
+        // only that much is sure to have been read.
+        SourceLocation loc = LineIndex(first, std::min(last, e.at.last)).locate(e.at);
+        err << path << ":" << loc.line << ":" << loc.column << ": token " << e.token << std::endl;
+    }
+}
+
+std::unique_ptr<Program> parse_and_print(std::vector<Token> tokens, const char* first, const char* last,
+                                         const std::string& path, const ParseOptions& options, std::ostream& out,
+                                         std::ostream& err, Stats& stats, bool show_stats) {
+    Parser parser(std::move(tokens));
+    return parse_and_print([&] { return parser.parse(); }, first, last, path, options, out, err, stats, show_stats);
+}
+
+std::unique_ptr<Program> parse_and_print(const std::function<std::unique_ptr<Program>()>& parse, const char* first, const char* last,
+                                         const std::string& path, const ParseOptions& options, std::ostream& out,
+                                         std::ostream& err, Stats& stats, bool show_stats) {
+    try {
+        stats.begin("parse");
+        std::unique_ptr<Program> ast = parse();
+        if (options.fold) {
+            stats.begin("fold");
+            size_t removed = fold_constants(*ast);
+            err << "fold: removed " << removed << " nodes" << std::endl;
+        }
+        stats.begin("print");
+        ast->print(out);
+        out << std::endl;
+        stats.end();
+        if (show_stats) {
+            count_nodes_by_kind(*ast, stats.node_counts);
+        }
+        return ast;
+    } catch (const ParseError& e) {
+        stats.end();
+        print_parse_error(e, first, last, path, options, out, err);
+    } catch (const std::runtime_error& e) {
+        stats.end();
+        out << e.what() << std::endl;
+    }
+    return nullptr;
+}
+
+bool write_requested_snapshot(const Program* ast, const ParseOptions& options, std::ostream& err) {
+    if (!ast || options.write_snapshot_path.empty()) return true;
+    try {
+        snapshot::write_snapshot(*ast, options.write_snapshot_path);
+        return true;
+    } catch (const std::runtime_error& e) {
+        err << e.what() << std::endl;
+        return false;
+    }
+}
+
+bool check_and_print(const std::function<void()>& check, const char* first, const char* last,
+                     const std::string& path, const ParseOptions& options, std::ostream& out,
+                     std::ostream& err, Stats& stats) {
+    try {
+        stats.begin("check");
+        check();
+        stats.end();
+        return true;
+    } catch (const ParseError& e) {
+        stats.end();
+        print_parse_error(e, first, last, path, options, out, err);
+    } catch (const std::runtime_error& e) {
+        stats.end();
+        out << e.what() << std::endl;
+    }
+    return false;
+}
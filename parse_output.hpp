@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ast.hpp"
+#include "lexer.hpp"
+#include "stats.hpp"
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// The output of `parse`, shared with the compile server so a result reads
+// the same whichever of them produced it.
+
+struct ParseOptions {
+    bool fold = false;
+    bool show_locations = false;
+    std::string write_snapshot_path;
+};
+
+// Parses `tokens` and prints the AST to `out` the way `parse` does, or the
+// parse error in its place. Diagnostics go to `err`; [first, last) is the
+// text the tokens point into, used for --locations. Records the parse, fold
+// and print phases into `stats`, and the node counts when `show_stats` is set.
+// Returns the AST, or null if there is none to show.
+std::unique_ptr<Program> parse_and_print(std::vector<Token> tokens, const char* first, const char* last,
+                                         const std::string& path, const ParseOptions& options, std::ostream& out,
+                                         std::ostream& err, Stats& stats, bool show_stats);
+
+// Same, with `parse` in place of parsing a token vector, e.g. a BasicParser
+// over another token source.
+std::unique_ptr<Program> parse_and_print(const std::function<std::unique_ptr<Program>()>& parse, const char* first, const char* last,
+                                         const std::string& path, const ParseOptions& options, std::ostream& out,
+                                         std::ostream& err, Stats& stats, bool show_stats);
+
+// Writes `ast` to options.write_snapshot_path, if there are both. Returns
+// false after printing the error to `err` if the snapshot can't be written,
+// so the caller can exit with a failure; the AST is already on `out`.
+bool write_requested_snapshot(const Program* ast, const ParseOptions& options, std::ostream& err);
+
+// For `parse --check`: runs `check`, e.g. a BasicSyntaxChecker's, and prints
+// nothing if it returns, or the parse error as parse_and_print would. Returns
+// whether the input parsed.
+bool check_and_print(const std::function<void()>& check, const char* first, const char* last,
+                     const std::string& path, const ParseOptions& options, std::ostream& out,
+                     std::ostream& err, Stats& stats);
@@ -1,127 +1,235 @@
 #include "parser.hpp"
+#include <algorithm>
+
+// Helper to convert the string tokens from the file into Token structs.
+// Tokens are separated by single spaces; `Id(x)`, `Num(42)` and `Error(..)`
+// carry a payload, which the token's range covers. Num payloads are
+// converted to their value here, as the lexer does.
+std::vector<Token> tokenize_input(const std::string& line) {
+    std::vector<Token> tokens;
+    const char* it = line.data();
+    const char* end = it + line.size();
+    while (it != end) {
+        const char* word_end = std::find(it, end, ' ');
+        if (word_end != it) {
+            const char* open_paren = std::find(it, word_end, '(');
+            if (open_paren != word_end) {
+                // Token with value, e.g., Id(x) or Num(42)
+                const char* value_last = std::max(open_paren + 1, word_end - 1);
+                TokenType type = token_type_from_name(it, open_paren);
+                int64_t value = type == TokenType::Num ? num_value(open_paren + 1, value_last) : 0;
+                tokens.push_back({type, open_paren + 1, value_last, value});
+            } else {
+                tokens.push_back({token_type_from_name(it, word_end), it, word_end});
+            }
+        }
+        it = word_end == end ? end : word_end + 1;
+    }
+    return tokens;
+}
 
-Parser::Parser(std::vector<Token> tokens) : m_tokens(std::move(tokens)) {}
+// The text of a token, e.g. the name of an Id.
+static std::string text(const Token& token) {
+    return std::string(token.first, token.last);
+}
 
-std::unique_ptr<Program> Parser::parse() {
+template <typename Source>
+std::unique_ptr<Program> BasicParser<Source>::parse() {
     return parse_program();
 }
 
 // --- Main Parsing Logic ---
 
 // program ::= (struct | extern | function)+
-std::unique_ptr<Program> Parser::parse_program() {
-    auto program = std::make_unique<Program>();
+template <typename Source>
+std::unique_ptr<Program> BasicParser<Source>::parse_program() {
+    auto program = located(position(), std::make_unique<Program>());
+    m_types = program->types.get();
     
     // Grammar requires at least one (struct | extern | function)
     if (is_at_end()) {
         error("unexpected end of token stream");
     }
     
-    while (!is_at_end()) {
-        if (check("Struct")) {
-            program->structs.push_back(parse_struct_def());
-        } else if (check("Extern")) {
-            program->externs.push_back(parse_extern_def());
-        } else if (check("Fn")) {
-            program->functions.push_back(parse_function_def());
-        } else {
-            error("unexpected token at token " + std::to_string(peek().index));
+    try {
+        while (!is_at_end()) {
+            if (check(TokenType::Struct)) {
+                program->structs.push_back(parse_struct_def());
+            } else if (check(TokenType::Extern)) {
+                program->externs.push_back(parse_extern_def());
+            } else if (check(TokenType::Fn)) {
+                program->functions.push_back(parse_function_def());
+            } else {
+                error("unexpected token at token " + std::to_string(current_index()));
+            }
         }
+    } catch (const ParseError&) {
+        // A full parse would have stopped at the first error in a body
+        // skipped so far, which comes before this one.
+        if (m_defer_bodies) {
+            for (const auto& func : program->functions) func->stmts();
+        }
+        throw;
     }
+    if (m_body_tokens) m_body_tokens->shrink_to_fit();
     return program;
 }
 
 // function ::= `fn` id `(` LIST(decl) `)` `->` type `{` let⋆ stmt⋆ `}`
-std::unique_ptr<FunctionDef> Parser::parse_function_def() {
-    consume("Fn", "unexpected token at token " + std::to_string(peek().index));
-    Token name = consume("Id", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::unique_ptr<FunctionDef> BasicParser<Source>::parse_function_def() {
+    size_t start = position();
+    consume(TokenType::Fn, "unexpected token at token " + std::to_string(current_index()));
+    Token name = consume(TokenType::Id, "unexpected token at token " + std::to_string(current_index()));
 
-    auto func = std::make_unique<FunctionDef>();
-    func->name = name.value;
+    auto func = located(start, std::make_unique<FunctionDef>());
+    func->name = text(name);
 
-    consume("OpenParen", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::OpenParen, "unexpected token at token " + std::to_string(current_index()));
     // Parse LIST(decl) for vector of parameters (decls)
-    if (!check("CloseParen")) { // skip list if no params
+    if (!check(TokenType::CloseParen)) { // skip list if no params
         do {
             func->params.push_back(parse_decl());
-        } while (check("Comma") && (advance(), true)); // Consume comma and continue
+        } while (check(TokenType::Comma) && (advance(), true)); // Consume comma and continue
     }
-    consume("CloseParen", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::CloseParen, "unexpected token at token " + std::to_string(current_index()));
 
-    consume("Arrow", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::Arrow, "unexpected token at token " + std::to_string(current_index()));
     func->rettype = parse_type();
 
-    consume("OpenBrace", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::OpenBrace, "unexpected token at token " + std::to_string(current_index()));
 
     // Parse local `let` declarations
     // let ::= `let` LIST(decl) `;`
-    while (check("Let")) {
-        consume("Let", "unexpected token at token " + std::to_string(peek().index));
-        if (!check("Semicolon")) { // skip list if no locals
+    while (check(TokenType::Let)) {
+        consume(TokenType::Let, "unexpected token at token " + std::to_string(current_index()));
+        if (!check(TokenType::Semicolon)) { // skip list if no locals
             do {
                 func->locals.push_back(parse_decl());
-            } while (check("Comma") && (advance(), true)); // Consume comma and continue
+            } while (check(TokenType::Comma) && (advance(), true)); // Consume comma and continue
         }
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
     }
 
-    // Parse statements in the body
-    while (!check("CloseBrace") && !is_at_end()) {
-        func->stmts.push_back(parse_stmt());
+    // Parse statements in the body, or leave them for later
+    if (m_defer_bodies) {
+        defer_body(*func);
+    } else {
+        func->stmts() = parse_body();
     }
-
-    consume("CloseBrace", "unexpected token at token " + std::to_string(peek().index));
     return func;
 }
 
+// stmt⋆ `}`, the rest of a function body after its locals
+template <typename Source>
+std::vector<std::unique_ptr<Stmt>> BasicParser<Source>::parse_body() {
+    std::vector<std::unique_ptr<Stmt>> stmts;
+    while (!check(TokenType::CloseBrace) && !is_at_end()) {
+        stmts.push_back(parse_stmt());
+    }
+    consume(TokenType::CloseBrace, "unexpected token at token " + std::to_string(current_index()));
+    return stmts;
+}
+
+// Skips the rest of a function body through the `}` matching its `{`, and
+// leaves `func` to run parse_body over its tokens when its statements are
+// first asked for. A VectorSource's tokens are shared with the body in
+// place; from any other source they are copied aside. Either way they keep
+// their indices, so errors read the same as from a full parse.
+template <typename Source>
+void BasicParser<Source>::defer_body(FunctionDef& func) {
+    constexpr bool shared = requires { m_tokens.shared_tokens(); };
+    if (!shared && !m_body_tokens) m_body_tokens = std::make_shared<std::vector<Token>>();
+    size_t base = position();
+    size_t offset = shared ? base : m_body_tokens->size();
+    for (size_t depth = 1; depth != 0; ) {
+        if (is_at_end()) {
+            // Report the body's own first error, as a full parse would.
+            if constexpr (shared) {
+                SavedBody(m_tokens.shared_tokens(), offset, position() - base, base, m_types).parse();
+            } else {
+                SavedBody(m_body_tokens, offset, position() - base, base, m_types).parse();
+            }
+            error("unexpected end of token stream");
+        }
+        TokenType type = m_tokens.type();
+        if (type == TokenType::OpenBrace) {
+            ++depth;
+        } else if (type == TokenType::CloseBrace) {
+            --depth;
+        }
+        if constexpr (!shared) m_body_tokens->push_back(m_tokens.token());
+        m_tokens.advance();
+    }
+    size_t count = position() - base;
+    if constexpr (shared) {
+        func.defer_body(std::make_unique<SavedBody>(m_tokens.shared_tokens(), offset, count, base, m_types));
+    } else {
+        func.defer_body(std::make_unique<SavedBody>(m_body_tokens, offset, count, base, m_types));
+    }
+}
+
+template <typename Source>
+std::vector<std::unique_ptr<Stmt>> BasicParser<Source>::SavedBody::parse() const {
+    const Token* first = m_tokens->data() + m_offset;
+    BasicParser<SpanSource> body(SpanSource(first, first + m_count, m_base));
+    body.m_types = m_types;
+    return body.parse_body();
+}
+
 // decl ::= id `:` type
-std::unique_ptr<Decl> Parser::parse_decl() {
-    Token name = consume("Id", "unexpected token at token " + std::to_string(peek().index));
-    consume("Colon", "unexpected token at token " + std::to_string(peek().index));
-    auto type = parse_type();
-    return std::make_unique<Decl>(name.value, std::move(type));
+template <typename Source>
+std::unique_ptr<Decl> BasicParser<Source>::parse_decl() {
+    size_t start = position();
+    Token name = consume(TokenType::Id, "unexpected token at token " + std::to_string(current_index()));
+    consume(TokenType::Colon, "unexpected token at token " + std::to_string(current_index()));
+    const Type* type = parse_type();
+    return located(start, std::make_unique<Decl>(text(name), type));
 }
 
 // stmt ::= exp (`=` exp)? `;` | `if`... | `while`... | `break`... | `continue`... | `return`...
-std::unique_ptr<Stmt> Parser::parse_stmt() {
-    if (check("If")) return parse_if_stmt();
-    if (check("While")) return parse_while_stmt();
-    if (check("Return")) return parse_return_stmt();
-
-    if (check("Break")) {
+template <typename Source>
+std::unique_ptr<Stmt> BasicParser<Source>::parse_stmt() {
+    if (check(TokenType::If)) return parse_if_stmt();
+    if (check(TokenType::While)) return parse_while_stmt();
+    if (check(TokenType::Return)) return parse_return_stmt();
+
+    size_t start = position();
+    if (check(TokenType::Break)) {
         advance();
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
-        return std::make_unique<Break>();
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
+        return located(start, std::make_unique<Break>());
     }
-    if (check("Continue")) {
+    if (check(TokenType::Continue)) {
         advance();
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
-        return std::make_unique<Continue>();
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
+        return located(start, std::make_unique<Continue>());
     }
 
     // exp (`=` exp)? `;`
     // The left-hand side of an assignment must be a Place.
-    size_t start_token_index = peek().index;
+    size_t start_token_index = current_index();
+    Token start_token = peek();
     auto left_exp = parse_exp();
 
-    if (check("Gets")) { // Assignment: exp = exp;
+    if (check(TokenType::Gets)) { // Assignment: exp = exp;
         advance(); // consume '='
         auto right_exp = parse_exp();
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
 
         if (auto val = dynamic_cast<Val*>(left_exp.get())) {
             std::unique_ptr<Place> place_ptr = std::move(val->place);
-            return std::make_unique<Assign>(std::move(place_ptr), std::move(right_exp));
+            return located(start, std::make_unique<Assign>(std::move(place_ptr), std::move(right_exp)));
         } else {
-            error("left-hand side of assignment must be a place, starting at token " + std::to_string(start_token_index));
+            error_at(start_token_index, start_token, "left-hand side of assignment must be a place, starting at token " + std::to_string(start_token_index));
         }
     } else { // Standalone expression: exp;
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
         if (auto call_exp = dynamic_cast<CallExp*>(left_exp.get())) {
             std::unique_ptr<FunCall> fc = std::move(call_exp->fun_call);
-            return std::make_unique<CallStmt>(std::move(fc));
+            return located(start, std::make_unique<CallStmt>(std::move(fc)));
         } else {
-            error("standalone expressions must be function calls, starting at token " + std::to_string(start_token_index));
+            error_at(start_token_index, start_token, "standalone expressions must be function calls, starting at token " + std::to_string(start_token_index));
         }
     }
     // Unreachable: error(...) throws
@@ -129,43 +237,50 @@ std::unique_ptr<Stmt> Parser::parse_stmt() {
 }
 
 // `if` exp block (`else` block)?
-std::unique_ptr<Stmt> Parser::parse_if_stmt() {
-    consume("If", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::unique_ptr<Stmt> BasicParser<Source>::parse_if_stmt() {
+    size_t start = position();
+    consume(TokenType::If, "unexpected token at token " + std::to_string(current_index()));
     auto guard = parse_exp();
     std::vector<std::unique_ptr<Stmt>> tt = parse_block();
     std::vector<std::unique_ptr<Stmt>> ff;
-    if (check("Else")) {
+    if (check(TokenType::Else)) {
         advance(); // consume 'else'
     ff = parse_block();
     }
-    return std::make_unique<If>(std::move(guard), std::move(tt), std::move(ff));
+    return located(start, std::make_unique<If>(std::move(guard), std::move(tt), std::move(ff)));
 }
 
 // block ::= `{` stmt⋆ `}`
-std::vector<std::unique_ptr<Stmt>> Parser::parse_block() {
-    consume("OpenBrace", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::vector<std::unique_ptr<Stmt>> BasicParser<Source>::parse_block() {
+    consume(TokenType::OpenBrace, "unexpected token at token " + std::to_string(current_index()));
     std::vector<std::unique_ptr<Stmt>> stmts;
-    while (!check("CloseBrace") && !is_at_end()) {
+    while (!check(TokenType::CloseBrace) && !is_at_end()) {
         stmts.push_back(parse_stmt());
     }
-    consume("CloseBrace", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::CloseBrace, "unexpected token at token " + std::to_string(current_index()));
     return stmts;
 }
 
 // `while` exp block
-std::unique_ptr<Stmt> Parser::parse_while_stmt() {
-    consume("While", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::unique_ptr<Stmt> BasicParser<Source>::parse_while_stmt() {
+    size_t start = position();
+    consume(TokenType::While, "unexpected token at token " + std::to_string(current_index()));
     auto guard = parse_exp();
     auto body = parse_block();
-    return std::make_unique<While>(std::move(guard), std::move(body));
+    return located(start, std::make_unique<While>(std::move(guard), std::move(body)));
 }
 
 // `return` exp `;`
-std::unique_ptr<Stmt> Parser::parse_return_stmt() {
-    consume("Return", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::unique_ptr<Stmt> BasicParser<Source>::parse_return_stmt() {
+    size_t start = position();
+    consume(TokenType::Return, "unexpected token at token " + std::to_string(current_index()));
     auto exp = parse_exp();
-    consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
-    return std::make_unique<Return>(std::move(exp));
+    consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
+    return located(start, std::make_unique<Return>(std::move(exp)));
 }
 
 // --- Expression Parsing ---
@@ -184,97 +299,109 @@ std::unique_ptr<Stmt> Parser::parse_return_stmt() {
 //        | `(` exp `)`
 
 // exp  ::= exp1 (`?` exp `:` exp1)⋆
-std::unique_ptr<Exp> Parser::parse_exp() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp() {
+    size_t start = position();
     auto left = parse_exp1(); // Parse higher-precedence expression
 
-    while (check("QuestionMark")) { // TODO no check parens??
+    while (check(TokenType::QuestionMark)) { // TODO no check parens??
         advance(); // consume '?'
         auto true_exp = parse_exp();
-        consume("Colon", "unexpected token at token " + std::to_string(peek().index));
+        consume(TokenType::Colon, "unexpected token at token " + std::to_string(current_index()));
         auto false_exp = parse_exp1();
-        left = std::make_unique<Select>(std::move(left), std::move(true_exp), std::move(false_exp));
+        left = located(start, std::make_unique<Select>(std::move(left), std::move(true_exp), std::move(false_exp)));
     }
     return left;
 }
 
 // exp1 ::= exp2 ([`and`,`or`] exp2)⋆
-std::unique_ptr<Exp> Parser::parse_exp1() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp1() {
+    size_t start = position();
     // Right-associative for logical operators 'and'/'or'
     auto left = parse_exp2();
-    if (check_any({"And", "Or"})) {
+    if (check_any({TokenType::And, TokenType::Or})) {
         Token op_token = advance();
         // For right-assoc, parse the rest at the same precedence level recursively
         auto right = parse_exp1();
-        BinaryOp op = (op_token.type == "And") ? BinaryOp::And : BinaryOp::Or;
-        return std::make_unique<BinOp>(op, std::move(left), std::move(right));
+        BinaryOp op = (op_token.token_type == TokenType::And) ? BinaryOp::And : BinaryOp::Or;
+        return located(start, std::make_unique<BinOp>(op, std::move(left), std::move(right)));
     }
     return left;
 }
 
 // exp2 ::= exp3 ([`==`,`!=`,`<`,`<=`,`>`,`>=`] exp3)⋆
-std::unique_ptr<Exp> Parser::parse_exp2() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp2() {
+    size_t start = position();
     auto left = parse_exp3(); // Parse higher-precedence expression
 
     // Handle ==, !=, <, <=, >, >= (left-associative)
-    while (check_any({"Equal", "NotEq", "Lt", "Lte", "Gt", "Gte"})) {
+    while (check_any({TokenType::Equal, TokenType::NotEq, TokenType::Lt, TokenType::Lte, TokenType::Gt, TokenType::Gte})) {
         Token op_token = advance();
         auto right = parse_exp3();
 
         BinaryOp op;
-        if (op_token.type == "Equal") {
+        if (op_token.token_type == TokenType::Equal) {
             op = BinaryOp::Eq;
-        } else if (op_token.type == "NotEq") {
+        } else if (op_token.token_type == TokenType::NotEq) {
             op = BinaryOp::NotEq;
-        } else if (op_token.type == "Lt") {
+        } else if (op_token.token_type == TokenType::Lt) {
             op = BinaryOp::Lt;
-        } else if (op_token.type == "Lte") {
+        } else if (op_token.token_type == TokenType::Lte) {
             op = BinaryOp::Lte;
-        } else if (op_token.type == "Gt") {
+        } else if (op_token.token_type == TokenType::Gt) {
             op = BinaryOp::Gt;
-        } else if (op_token.type == "Gte") {
+        } else if (op_token.token_type == TokenType::Gte) {
             op = BinaryOp::Gte;
         } else {
-            error("unexpected token at token " + std::to_string(op_token.index));
+            error_at(position() - 1, previous(), "unexpected token at token " + std::to_string(position() - 1));
         }
-        left = std::make_unique<BinOp>(op, std::move(left), std::move(right));
+        left = located(start, std::make_unique<BinOp>(op, std::move(left), std::move(right)));
     }
     return left;
 }
 
 // exp3 ::= exp4 ((`+`|`-`) exp4)*
-std::unique_ptr<Exp> Parser::parse_exp3() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp3() {
+    size_t start = position();
     auto left = parse_exp4(); // Parse higher-precedence expression
 
-    while (check_any({"Plus", "Dash"})) {
+    while (check_any({TokenType::Plus, TokenType::Dash})) {
         Token op_token = advance();
         auto right = parse_exp4();
         
-        BinaryOp op = (op_token.type == "Plus") ? BinaryOp::Add : BinaryOp::Sub;
-        left = std::make_unique<BinOp>(op, std::move(left), std::move(right));
+        BinaryOp op = (op_token.token_type == TokenType::Plus) ? BinaryOp::Add : BinaryOp::Sub;
+        left = located(start, std::make_unique<BinOp>(op, std::move(left), std::move(right)));
     }
     return left;
 }
 
 // exp4 ::= exp5 ((`*`|`/`) exp5)*
-std::unique_ptr<Exp> Parser::parse_exp4() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp4() {
+    size_t start = position();
     auto left = parse_exp5(); // Parse higher-precedence expression
-    while (check_any({"Star", "Slash"})) {
+    while (check_any({TokenType::Star, TokenType::Slash})) {
         Token op_token = advance();
         auto right = parse_exp5();
-        BinaryOp op = (op_token.type == "Star") ? BinaryOp::Mul : BinaryOp::Div;
-        left = std::make_unique<BinOp>(op, std::move(left), std::move(right));
+        BinaryOp op = (op_token.token_type == TokenType::Star) ? BinaryOp::Mul : BinaryOp::Div;
+        left = located(start, std::make_unique<BinOp>(op, std::move(left), std::move(right)));
     }
     return left;
 }
 
 // exp5 ::= unop⋆ exp6
-std::unique_ptr<Exp> Parser::parse_exp5() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp5() {
+    size_t start = position();
     // Handle unary operators (right-associative)
-    if (check_any({"Dash", "Not"})) {
+    if (check_any({TokenType::Dash, TokenType::Not})) {
         Token op_token = advance();
         auto exp = parse_exp5(); // Right-associative
-        UnaryOp op = (op_token.type == "Dash") ? UnaryOp::Neg : UnaryOp::Not;
-        return std::make_unique<UnOp>(op, std::move(exp));
+        UnaryOp op = (op_token.token_type == TokenType::Dash) ? UnaryOp::Neg : UnaryOp::Not;
+        return located(start, std::make_unique<UnOp>(op, std::move(exp)));
     }
     return parse_exp6();
 }
@@ -283,42 +410,44 @@ std::unique_ptr<Exp> Parser::parse_exp5() {
 // call_or_access ::= `[` exp `]`
                 //  | `.` (id | `*`)
                 //  | `(` LIST(exp) `)`
-std::unique_ptr<Exp> Parser::parse_exp6() {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp6() {
+    size_t start = position();
     auto exp = parse_exp7(); // Start with a primary expression.
 
     while (true) {
-        if (check("OpenBracket")) {
+        if (check(TokenType::OpenBracket)) {
             advance();
             auto index = parse_exp();
-            consume("CloseBracket", "unexpected token at token " + std::to_string(peek().index));
+            consume(TokenType::CloseBracket, "unexpected token at token " + std::to_string(current_index()));
             // Create a Place from the current expression
-            auto place = std::make_unique<ArrayAccess>(std::move(exp), std::move(index));
+            auto place = located(start, std::make_unique<ArrayAccess>(std::move(exp), std::move(index)));
             // Wrap the new Place in a Val to continue the expression chain
-            exp = std::make_unique<Val>(std::move(place));
-        } else if (check("Dot")) {
+            exp = located(start, std::make_unique<Val>(std::move(place)));
+        } else if (check(TokenType::Dot)) {
             advance();
-            if (check("Id")) {
+            if (check(TokenType::Id)) {
                 Token field_token = advance();
-                auto place = std::make_unique<FieldAccess>(std::move(exp), field_token.value);
-                exp = std::make_unique<Val>(std::move(place));
-            } else if (check("Star")) {
+                auto place = located(start, std::make_unique<FieldAccess>(std::move(exp), text(field_token)));
+                exp = located(start, std::make_unique<Val>(std::move(place)));
+            } else if (check(TokenType::Star)) {
                 advance();
-                auto place = std::make_unique<Deref>(std::move(exp));
-                exp = std::make_unique<Val>(std::move(place));
+                auto place = located(start, std::make_unique<Deref>(std::move(exp)));
+                exp = located(start, std::make_unique<Val>(std::move(place)));
             } else {
-                error("unexpected token at token " + std::to_string(peek().index));
+                error("unexpected token at token " + std::to_string(current_index()));
             }
-        } else if (check("OpenParen")) {
+        } else if (check(TokenType::OpenParen)) {
             advance();
             auto args = std::vector<std::unique_ptr<Exp>>();
-            if (!check("CloseParen")) {
+            if (!check(TokenType::CloseParen)) {
                 do {
                     args.push_back(parse_exp());
-                } while (check("Comma") && (advance(), true));
+                } while (check(TokenType::Comma) && (advance(), true));
             }
-            consume("CloseParen", "unexpected token at token " + std::to_string(peek().index));
-            auto fc = std::make_unique<FunCall>(std::move(exp), std::move(args));
-            exp = std::make_unique<CallExp>(std::move(fc));
+            consume(TokenType::CloseParen, "unexpected token at token " + std::to_string(current_index()));
+            auto fc = located(start, std::make_unique<FunCall>(std::move(exp), std::move(args)));
+            exp = located(start, std::make_unique<CallExp>(std::move(fc)));
         } else {
             // No more call_or_access operators, break the loop.
             break;
@@ -333,44 +462,45 @@ std::unique_ptr<Exp> Parser::parse_exp6() {
     //    | `new` type
     //    | `[` type `;` exp `]`
     //    | `(` exp `)`
-std::unique_ptr<Exp> Parser::parse_exp7() {
-    if (check("Id")) {
+template <typename Source>
+std::unique_ptr<Exp> BasicParser<Source>::parse_exp7() {
+    size_t start = position();
+    if (check(TokenType::Id)) {
         Token id_token = advance();
-        auto id_place = std::make_unique<Id>(id_token.value);
-        return std::make_unique<Val>(std::move(id_place));
+        auto id_place = located(start, std::make_unique<Id>(text(id_token)));
+        return located(start, std::make_unique<Val>(std::move(id_place)));
     }
-    if (check("Num")) {
+    if (check(TokenType::Num)) {
         Token num_token = advance();
-        try {
-            return std::make_unique<Num>(std::stoll(num_token.value));
-        } catch (const std::out_of_range&) {
-            error("invalid i64 number " + num_token.value + " at token " + std::to_string(num_token.index));
+        if (num_token.overflow()) {
+            error_at(position() - 1, num_token, "invalid i64 number " + text(num_token) + " at token " + std::to_string(position() - 1));
         }
+        return located(start, std::make_unique<Num>(num_token.value));
     }
-    if (check("Nil")) {
+    if (check(TokenType::Nil)) {
         advance();
-        return std::make_unique<NilExp>();
+        return located(start, std::make_unique<NilExp>());
     }
-    if (check("New")) {
+    if (check(TokenType::New)) {
         advance();
-        auto type = parse_type();
-        return std::make_unique<NewSingle>(std::move(type));
+        const Type* type = parse_type();
+        return located(start, std::make_unique<NewSingle>(type));
     }
-    if (check("OpenBracket")) {
+    if (check(TokenType::OpenBracket)) {
         advance();
-        auto type = parse_type();
-        consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
+        const Type* type = parse_type();
+        consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
         auto size_exp = parse_exp();
-        consume("CloseBracket", "unexpected token at token " + std::to_string(peek().index));
-        return std::make_unique<NewArray>(std::move(type), std::move(size_exp));
+        consume(TokenType::CloseBracket, "unexpected token at token " + std::to_string(current_index()));
+        return located(start, std::make_unique<NewArray>(type, std::move(size_exp)));
     }
-    if (check("OpenParen")) {
+    if (check(TokenType::OpenParen)) {
         advance();
         auto exp = parse_exp();
-        consume("CloseParen", "unexpected token at token " + std::to_string(peek().index));
+        consume(TokenType::CloseParen, "unexpected token at token " + std::to_string(current_index()));
         return exp;
     }
-    error("unexpected token at token " + std::to_string(peek().index));
+    error("unexpected token at token " + std::to_string(current_index()));
     return nullptr; // Unreachable
 }
 
@@ -379,112 +509,115 @@ std::unique_ptr<Exp> Parser::parse_exp7() {
     //    | `&` type      # pointer type
     //    | `[` type `]`  # array type
     //    | funtype       # function type
-std::unique_ptr<Type> Parser::parse_type() {
-    if (check("Int")) {
+template <typename Source>
+const Type* BasicParser<Source>::parse_type() {
+    if (check(TokenType::Int)) {
         advance();
-        return std::make_unique<IntType>();
+        return m_types->int_type();
     }
-    else if (check("Id")) {
+    else if (check(TokenType::Id)) {
         Token id_token = advance();
-        return std::make_unique<StructType>(id_token.value);
+        return m_types->struct_type(text(id_token));
     }
-    else if (check("Ampersand")) {
+    else if (check(TokenType::Ampersand)) {
         advance();
-        auto inner_type = parse_type();
-        return std::make_unique<PtrType>(std::move(inner_type));
+        const Type* inner_type = parse_type();
+        return m_types->ptr_type(inner_type);
     }
-    else if (check("OpenBracket")) {
+    else if (check(TokenType::OpenBracket)) {
         advance();
-        auto inner_type = parse_type();
-        consume("CloseBracket", "unexpected token at token " + std::to_string(peek().index));
-        return std::make_unique<ArrayType>(std::move(inner_type));
+        const Type* inner_type = parse_type();
+        consume(TokenType::CloseBracket, "unexpected token at token " + std::to_string(current_index()));
+        return m_types->array_type(inner_type);
     }
     return parse_funtype(); // Fallback to function type
 }
 
 // funtype ::= `(` LIST(type) `)` `->` type
-std::unique_ptr<Type> Parser::parse_funtype() {
-    consume("OpenParen", "unexpected token at token " + std::to_string(peek().index));
-    std::vector<std::unique_ptr<Type>> param_types;
-    if (!check("CloseParen")) { // skip list if no params
+template <typename Source>
+const Type* BasicParser<Source>::parse_funtype() {
+    consume(TokenType::OpenParen, "unexpected token at token " + std::to_string(current_index()));
+    std::vector<const Type*> param_types;
+    if (!check(TokenType::CloseParen)) { // skip list if no params
         do {
             param_types.push_back(parse_type());
-        } while (check("Comma") && (advance(), true)); // Consume comma and continue
+        } while (check(TokenType::Comma) && (advance(), true)); // Consume comma and continue
     }
-    consume("CloseParen", "unexpected token at token " + std::to_string(peek().index));
-    consume("Arrow", "unexpected token at token " + std::to_string(peek().index));
-    auto return_type = parse_type();
-    return std::make_unique<FnType>(std::move(param_types), std::move(return_type));
+    consume(TokenType::CloseParen, "unexpected token at token " + std::to_string(current_index()));
+    consume(TokenType::Arrow, "unexpected token at token " + std::to_string(current_index()));
+    const Type* return_type = parse_type();
+    return m_types->fn_type(std::move(param_types), return_type);
 }
 
 // `struct` id `{` LIST(decl) `}`
-std::unique_ptr<StructDef> Parser::parse_struct_def() {
-    consume("Struct", "unexpected token at token " + std::to_string(peek().index));
-    auto struct_def = std::make_unique<StructDef>();
-    Token name = consume("Id", "unexpected token at token " + std::to_string(peek().index));
-    struct_def->name = name.value;
-    consume("OpenBrace", "unexpected token at token " + std::to_string(peek().index));
+template <typename Source>
+std::unique_ptr<StructDef> BasicParser<Source>::parse_struct_def() {
+    size_t start = position();
+    consume(TokenType::Struct, "unexpected token at token " + std::to_string(current_index()));
+    auto struct_def = located(start, std::make_unique<StructDef>());
+    Token name = consume(TokenType::Id, "unexpected token at token " + std::to_string(current_index()));
+    struct_def->name = text(name);
+    consume(TokenType::OpenBrace, "unexpected token at token " + std::to_string(current_index()));
     // Parse LIST(decl) for vector of decls
-    if (!check("CloseBrace")) { // skip list if no params
+    if (!check(TokenType::CloseBrace)) { // skip list if no params
         do {
             struct_def->fields.push_back(parse_decl());
-        } while (check("Comma") && (advance(), true)); // Consume comma and continue
+        } while (check(TokenType::Comma) && (advance(), true)); // Consume comma and continue
     }
-    consume("CloseBrace", "unexpected token at token " + std::to_string(peek().index));
+    consume(TokenType::CloseBrace, "unexpected token at token " + std::to_string(current_index()));
     return struct_def;
 }
 
 // extern ::= `extern` id `:` funtype `;`
-std::unique_ptr<Decl> Parser::parse_extern_def() {
-    consume("Extern", "unexpected token at token " + std::to_string(peek().index));
-    Token id_token = consume("Id", "unexpected token at token " + std::to_string(peek().index));
-    consume("Colon", "unexpected token at token " + std::to_string(peek().index));
-    auto funtype = parse_funtype();
-    consume("Semicolon", "unexpected token at token " + std::to_string(peek().index));
-    return std::make_unique<Decl>(id_token.value, std::move(funtype));
+template <typename Source>
+std::unique_ptr<Decl> BasicParser<Source>::parse_extern_def() {
+    size_t start = position();
+    consume(TokenType::Extern, "unexpected token at token " + std::to_string(current_index()));
+    Token id_token = consume(TokenType::Id, "unexpected token at token " + std::to_string(current_index()));
+    consume(TokenType::Colon, "unexpected token at token " + std::to_string(current_index()));
+    const Type* funtype = parse_funtype();
+    consume(TokenType::Semicolon, "unexpected token at token " + std::to_string(current_index()));
+    return located(start, std::make_unique<Decl>(text(id_token), funtype));
 }
 
 // --- Helper Method Implementations ---
 
-bool Parser::is_at_end() const {
-    return m_current_pos >= m_tokens.size();
-}
-
-const Token& Parser::peek() const {
+template <typename Source>
+Token BasicParser<Source>::peek() {
     if (is_at_end()) {
         error("unexpected end of token stream");
     }
-    return m_tokens.at(m_current_pos);
+    return m_tokens.token();
 }
 
-const Token& Parser::previous() const {
-    return m_tokens.at(m_current_pos - 1);
+template <typename Source>
+Token BasicParser<Source>::advance() {
+    if (!is_at_end()) m_tokens.advance();
+    return previous();
 }
 
-Token Parser::advance() {
-    if (!is_at_end()) m_current_pos++;
-    return previous();
+template <typename Source>
+size_t BasicParser<Source>::current_index() {
+    peek(); // throws at the end of the stream
+    return position();
 }
 
-Token Parser::consume(const std::string& expected_type, const std::string& error_message) {
+template <typename Source>
+Token BasicParser<Source>::consume(TokenType expected_type, const std::string& error_message) {
     if (is_at_end()) {
         error("unexpected end of token stream");
     }
-    if (peek().type != expected_type) {
+    if (m_tokens.type() != expected_type) {
         error(error_message);
     }
     return advance();
 }
 
-bool Parser::check(const std::string& type) const {
+template <typename Source>
+bool BasicParser<Source>::check_any(std::initializer_list<TokenType> types) {
     if (is_at_end()) return false;
-    return peek().type == type;
-}
-
-bool Parser::check_any(const std::vector<std::string>& types) const {
-    if (is_at_end()) return false;
-    for (const auto& type : types) {
-        if (peek().type == type) return true;
+    for (TokenType type : types) {
+        if (m_tokens.type() == type) return true;
     }
     return false;
 }
@@ -495,7 +628,26 @@ bool Parser::check_any(const std::vector<std::string>& types) const {
 // - "parse error: left-hand side of assignment must be a place, starting at token <index>"
 // - "parse error: standalone expressions must be function calls, starting at token <index>"
 // - "parse error: invalid i64 number <string> at token <index>"
-void Parser::error(const std::string& message) const {
-    std::string full_message = "parse error: " + message;
-    throw std::runtime_error(full_message);
-}
\ No newline at end of file
+template <typename Source>
+void BasicParser<Source>::error(const std::string& message) const {
+    if (m_tokens.has_current()) {
+        error_at(position(), m_tokens.token(), message);
+    }
+    // Past the end of the stream: the error is about the last token.
+    if (position() == 0) {
+        error_at(0, Token{}, message);
+    }
+    error_at(position() - 1, previous(), message);
+}
+
+template <typename Source>
+void BasicParser<Source>::error_at(size_t token, const Token& at, const std::string& message) const {
+    throw ParseError("parse error: " + message, token, at);
+}
+
+template class BasicParser<VectorSource>;
+template class BasicParser<SoaSource>;
+template class BasicParser<MappedSource>;
+template class BasicParser<FeedSource>;
+template class BasicParser<LazyLexSource>;
+template class BasicParser<SpanSource>;
@@ -1,49 +1,123 @@
 #pragma once
 
 #include "ast.hpp"
+#include "lexer.hpp"
+#include "source_location.hpp"
+#include "token_source.hpp"
+#include <initializer_list>
+#include <memory>
 #include <vector>
 #include <string>
 #include <stdexcept>
 
-// A simple struct to represent a token from the lexer output
-struct Token {
-    std::string type;
-    std::string value; // Only used for Id and Num
-    size_t index;      // The token's position in the input stream
+// Converts one line of lexer output (e.g. `Fn Id(main) OpenParen`) into tokens.
+// The tokens point into `line`, which must outlive them. A token's position
+// in the returned vector is the index parse errors report.
+std::vector<Token> tokenize_input(const std::string& line);
+
+// Thrown for every parse error. `token` is the index of the token the
+// error is about, clamped to the last token when the stream ran out, and
+// `at` is that token (empty if there were none), so the error can be
+// located after a fed parser has dropped the tokens before it.
+struct ParseError : std::runtime_error {
+    ParseError(const std::string& message, size_t token, const Token& at)
+        : std::runtime_error(message), token(token), at(at) {}
+    size_t token;
+    Token at;
 };
 
-class Parser {
+// Parses the tokens of one program from a token source (token_source.hpp).
+// Each source gets its own instantiation, compiled in parser.cpp, with the
+// token accesses inlined; Parser is the one over a vector of tokens.
+template <typename Source>
+class BasicParser {
 public:
-    // Takes the vector of tokens from the lexer
-    explicit Parser(std::vector<Token> tokens);
+    // Takes the token source, e.g. the vector of tokens from the lexer
+    explicit BasicParser(Source tokens) : m_tokens(std::move(tokens)) {}
+
+    // The number of tokens consumed so far: all of them once parse() returned.
+    size_t tokens_read() const { return m_tokens.position(); }
+
+    // Records the first token of every node parse() creates into `out`.
+    // Off by default; the map is only touched when this is set.
+    void record_node_tokens(NodeTokens& out) { m_node_tokens = &out; }
+
+    // Leaves function bodies for later, for callers that mostly need only
+    // the signatures: parse() parses each function up to its locals and
+    // then just matches braces to find the end of the body, and
+    // FunctionDef::stmts() parses the body the first time it is called.
+    // Until then a copy of the body's tokens is kept with the FunctionDef,
+    // and the text they point into must still be there. Errors inside a
+    // body are thrown from stmts(), and its nodes aren't recorded; if
+    // parse() itself fails, it throws the first error in any body before
+    // that, so the error is the one a full parse reports. Bodies intern
+    // into the program's TypeInterner, so call stmts() from one thread.
+    void defer_function_bodies() { m_defer_bodies = true; }
 
     // The main entry point to start parsing.
     // Returns the root of the AST, the Program node.
     std::unique_ptr<Program> parse();
 
 private:
-    std::vector<Token> m_tokens;
-    size_t m_current_pos = 0;
+    Source m_tokens;
+    // The type table of the program being parsed; parse_type interns into it.
+    TypeInterner* m_types = nullptr;
+    NodeTokens* m_node_tokens = nullptr;
+    bool m_defer_bodies = false;
+    // Copies of the tokens of every deferred body, shared by the
+    // FunctionDefs that will parse them; not needed for a VectorSource.
+    std::shared_ptr<std::vector<Token>> m_body_tokens;
+
+    // A deferred body: a range of tokens it keeps alive, which it parses
+    // with a BasicParser<SpanSource> over them.
+    class SavedBody : public DeferredBody {
+    public:
+        SavedBody(std::shared_ptr<const std::vector<Token>> tokens, size_t offset, size_t count, size_t base,
+                  TypeInterner* types)
+            : m_tokens(std::move(tokens)), m_offset(offset), m_count(count), m_base(base), m_types(types) {}
+        std::vector<std::unique_ptr<Stmt>> parse() const override;
+
+    private:
+        std::shared_ptr<const std::vector<Token>> m_tokens;
+        size_t m_offset;  // into m_tokens, of the first token after the locals
+        size_t m_count;   // through the closing `}`
+        size_t m_base;    // the index of the first token in the whole stream
+        TypeInterner* m_types;
+    };
+    template <typename> friend class BasicParser;
 
     // --- Helper Methods ---
 
     // Checks if we've consumed all tokens.
-    bool is_at_end() const;
+    bool is_at_end() { return m_tokens.at_end(); }
+    // The index of the current token.
+    size_t position() const { return m_tokens.position(); }
     // Returns the current token without consuming it.
-    const Token& peek() const;
+    Token peek();
     // Returns the previous token.
-    const Token& previous() const;
+    Token previous() const { return m_tokens.previous(); }
+    // Returns the index of the current token; throws at the end of the stream.
+    size_t current_index();
     // Consumes and returns the current token, advancing the parser.
     Token advance();
     // Consumes the current token only if it matches the expected type.
     // Throws an error if it doesn't match.
-    Token consume(const std::string& expected_type, const std::string& error_message);
+    Token consume(TokenType expected_type, const std::string& error_message);
     // Checks if the current token is of a given type.
-    bool check(const std::string& type) const;
+    bool check(TokenType type) { return !m_tokens.at_end() && m_tokens.type() == type; }
     // Checks if the current token is one of several types.
-    bool check_any(const std::vector<std::string>& types) const;
-    // Formats and throws a runtime error for the main function to catch.
+    bool check_any(std::initializer_list<TokenType> types);
+    // Formats and throws a ParseError for the main function to catch.
     void error(const std::string& message) const;
+    // Same, for an error about a token other than the current one.
+    void error_at(size_t token, const Token& at, const std::string& message) const;
+
+    // Notes that `node` starts at token `first_token` if recording is on.
+    template <typename T>
+    std::unique_ptr<T> located(size_t first_token, std::unique_ptr<T> node) {
+        if (m_node_tokens) (*m_node_tokens)[node.get()] = first_token;
+        return node;
+    }
 
     // --- Parsing Methods for Each Grammar Rule ---
 
@@ -51,6 +125,8 @@ private:
     std::unique_ptr<StructDef> parse_struct_def();
     std::unique_ptr<Decl> parse_extern_def();
     std::unique_ptr<FunctionDef> parse_function_def();
+    std::vector<std::unique_ptr<Stmt>> parse_body();
+    void defer_body(FunctionDef& func);
     std::unique_ptr<Decl> parse_decl();
     std::unique_ptr<Stmt> parse_let();
 
@@ -62,8 +138,8 @@ private:
     std::vector<std::unique_ptr<Stmt>> parse_block();
 
     // Type Parsing
-    std::unique_ptr<Type> parse_type();
-    std::unique_ptr<Type> parse_funtype();
+    const Type* parse_type();
+    const Type* parse_funtype();
 
     // Expression Parsing (by precedence)
     std::unique_ptr<Exp> parse_exp();        // Precedence: ?: (Select)
@@ -74,4 +150,13 @@ private:
     std::unique_ptr<Exp> parse_exp5();       // Precedence: Unary operators (-, not)
     std::unique_ptr<Exp> parse_exp6();       // Precedence: Call, Array/Struct Access
     std::unique_ptr<Exp> parse_exp7();       // Precedence: Primary (literals, id, grouping)
-};
\ No newline at end of file
+};
+
+using Parser = BasicParser<VectorSource>;
+
+extern template class BasicParser<VectorSource>;
+extern template class BasicParser<SoaSource>;
+extern template class BasicParser<MappedSource>;
+extern template class BasicParser<FeedSource>;
+extern template class BasicParser<LazyLexSource>;
+extern template class BasicParser<SpanSource>;
@@ -0,0 +1,116 @@
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// glibc has no wrapper for this syscall.
+static int perf_event_open(perf_event_attr* attr) {
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, 0, -1, -1, 0));
+}
+
+static perf_event_attr event_attr(PerfCounters::Event event) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    switch (event) {
+        case PerfCounters::Cycles:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case PerfCounters::Instructions:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case PerfCounters::BranchMisses:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case PerfCounters::L1dMisses:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CACHE_MISSES;  // last level
+            break;
+    }
+    return attr;
+}
+
+PerfCounters::PerfCounters() {
+    for (int i = 0; i < EVENT_COUNT; ++i) {
+        perf_event_attr attr = event_attr(static_cast<Event>(i));
+        m_fds[i] = perf_event_open(&attr);
+        if (m_fds[i] < 0 && m_error.empty()) {
+            m_error = std::string(event_name(static_cast<Event>(i))) + ": " + std::strerror(errno);
+        }
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int fd : m_fds) {
+        if (fd >= 0) close(fd);
+    }
+}
+
+bool PerfCounters::available() const {
+    for (int fd : m_fds) {
+        if (fd >= 0) return true;
+    }
+    return false;
+}
+
+PerfCounters::Counts PerfCounters::read() const {
+    Counts counts;
+    for (int i = 0; i < EVENT_COUNT; ++i) {
+        uint64_t values[3];  // value, time enabled, time running
+        if (m_fds[i] < 0 || ::read(m_fds[i], values, sizeof values) != sizeof values) {
+            counts[i] = MISSING;
+        } else if (values[2] > 0 && values[2] < values[1]) {
+            counts[i] = static_cast<uint64_t>(static_cast<double>(values[0]) * values[1] / values[2]);
+        } else {
+            counts[i] = values[0];
+        }
+    }
+    return counts;
+}
+
+#else
+
+PerfCounters::PerfCounters() : m_error("perf_event_open is only available on Linux") {
+    m_fds.fill(-1);
+}
+
+PerfCounters::~PerfCounters() {}
+
+bool PerfCounters::available() const {
+    return false;
+}
+
+PerfCounters::Counts PerfCounters::read() const {
+    Counts counts;
+    counts.fill(MISSING);
+    return counts;
+}
+
+#endif
+
+const char* PerfCounters::event_name(Event event) {
+    switch (event) {
+        case Cycles: return "cycles";
+        case Instructions: return "instructions";
+        case BranchMisses: return "branch-misses";
+        case L1dMisses: return "L1d-misses";
+        case LlcMisses: return "LLC-misses";
+        default: return "unknown";
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware performance counters for the `--perf` flag of the drivers.
+//
+// On Linux each event is opened with perf_event_open for the calling thread
+// and left running; callers take a snapshot with read() at phase boundaries
+// and subtract. Work done on other threads isn't counted, so the drivers
+// refuse --perf for modes that lex or parse on more than one thread. Events
+// the kernel or CPU refuses (common in VMs and containers, or with a strict
+// perf_event_paranoid) are reported as missing rather than failing the run.
+// Elsewhere nothing is available.
+class PerfCounters {
+public:
+    enum Event { Cycles, Instructions, BranchMisses, L1dMisses, LlcMisses, EVENT_COUNT };
+
+    // Counter values at one point in time. MISSING marks an event that
+    // couldn't be opened.
+    static constexpr uint64_t MISSING = UINT64_MAX;
+    using Counts = std::array<uint64_t, EVENT_COUNT>;
+
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // True if at least one event is counting.
+    bool available() const;
+
+    // Why counters are missing, for the report; empty if all opened.
+    const std::string& error() const { return m_error; }
+
+    // Current values, scaled up for time lost to counter multiplexing.
+    Counts read() const;
+
+    static const char* event_name(Event event);
+
+private:
+    std::array<int, EVENT_COUNT> m_fds;
+    std::string m_error;
+};
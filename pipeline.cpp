@@ -0,0 +1,115 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Tokens taken from the ring per TokenFeed::more call.
+static constexpr size_t FEED_BATCH = 1024;
+
+Pipeline::Pipeline(const std::string& path, size_t chunk_bytes, size_t ring_tokens)
+    : m_path(path), m_chunk_bytes(std::max<size_t>(chunk_bytes, 1)), m_chunks(64), m_tokens(ring_tokens) {
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) throw std::runtime_error("pipeline error: could not open " + path);
+    struct stat st;
+    if (::fstat(m_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // Tokens point into the buffer as it fills, so it can't grow later.
+        m_source.assign(static_cast<size_t>(st.st_size), '\0');
+    } else {
+        // A pipe or the like has no size to allocate for; read it all here and
+        // overlap only lexing with parsing.
+        m_read_ahead = true;
+        char buffer[1 << 16];
+        for (;;) {
+            ssize_t n = ::read(m_fd, buffer, sizeof buffer);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                ::close(m_fd);
+                throw read_error();
+            }
+            if (n == 0) break;
+            m_source.append(buffer, static_cast<size_t>(n));
+        }
+    }
+    m_reader = std::thread([this] {
+        try {
+            read_chunks();
+        } catch (const std::exception&) {
+            m_read_error = std::current_exception();
+        }
+        m_chunks.close();
+    });
+    m_lexer = std::thread([this] {
+        try {
+            lex_chunks();
+        } catch (const std::exception&) {
+            m_lex_error = std::current_exception();
+        }
+        m_tokens.close();
+    });
+}
+
+Pipeline::~Pipeline() {
+    m_tokens.cancel();
+    m_lexer.join();
+    m_reader.join();
+    ::close(m_fd);
+}
+
+std::runtime_error Pipeline::read_error() const {
+    return std::runtime_error("pipeline error: could not read " + m_path + ": " + std::strerror(errno));
+}
+
+void Pipeline::read_chunks() {
+    size_t size = m_source.size();
+    if (m_read_ahead) {
+        m_chunks.push(&size, 1);
+        return;
+    }
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::read(m_fd, &m_source[done], std::min(m_chunk_bytes, size - done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw read_error();
+        if (n == 0) break;  // the file shrank; lexing stops where it ended
+        done += static_cast<size_t>(n);
+        if (!m_chunks.push(&done, 1)) return;
+    }
+}
+
+void Pipeline::lex_chunks() {
+    const char* first = m_source.data();
+    LexPrefixState state(first);
+    size_t available = 0;
+    std::vector<Token> tokens;
+    for (;;) {
+        size_t ends[16];
+        size_t n = m_chunks.pop(ends, 16);
+        if (n == 0 && m_read_error) return;
+        bool complete = n == 0;
+        if (!complete) available = ends[n - 1];
+        tokens.clear();
+        lex_prefix(state, first + available, complete, tokens);
+        if (!m_tokens.push(tokens.data(), tokens.size())) {
+            m_chunks.cancel();
+            return;
+        }
+        if (complete) return;
+    }
+}
+
+bool Pipeline::more(std::vector<Token>& tokens) {
+    size_t old_size = tokens.size();
+    tokens.resize(old_size + FEED_BATCH);
+    size_t n = m_tokens.pop(tokens.data() + old_size, FEED_BATCH);
+    tokens.resize(old_size + n);
+    if (n == 0) {
+        if (m_read_error) std::rethrow_exception(m_read_error);
+        if (m_lex_error) std::rethrow_exception(m_lex_error);
+    }
+    return n > 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "spsc_ring.hpp"
+#include "token_source.hpp"
+
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Reading, lexing and parsing a source file at the same time.
+//
+// The plain path reads the whole file, then lexes all of it, then parses
+// all the tokens. Here a reader thread reads the file in chunks and a lexer
+// thread lexes each chunk as it lands (lex_prefix), while the thread that
+// owns the Pipeline parses: the Pipeline is the parser's TokenFeed. The
+// threads hand over through SpscRings, so each stage runs as soon as the one
+// before it has something and none of them blocks on a lock.
+//
+//     Pipeline pipeline(path);
+//     BasicParser<FeedSource> parser(pipeline);
+//     auto program = parser.parse();
+//
+// The tokens point into the Pipeline's buffer, so it must outlive them. If
+// the parse stops early, e.g. on a parse error, destroying the Pipeline
+// stops the other threads.
+class Pipeline : public TokenFeed {
+public:
+    static constexpr size_t DEFAULT_CHUNK_BYTES = 64 << 10;
+    static constexpr size_t DEFAULT_RING_TOKENS = 16 << 10;
+
+    // Opens `path` and starts the reader and lexer threads. Throws
+    // std::runtime_error if the file can't be opened.
+    explicit Pipeline(const std::string& path, size_t chunk_bytes = DEFAULT_CHUNK_BYTES,
+                      size_t ring_tokens = DEFAULT_RING_TOKENS);
+    ~Pipeline() override;
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // The buffer the file is read into. Bytes not read yet are NUL.
+    const char* begin() const { return m_source.data(); }
+    const char* end() const { return m_source.data() + m_source.size(); }
+
+    // Throws std::runtime_error if reading the file failed.
+    bool more(std::vector<Token>& tokens) override;
+
+private:
+    void read_chunks();
+    void lex_chunks();
+    std::runtime_error read_error() const;  // from errno
+
+    std::string m_path;
+    std::string m_source;
+    int m_fd = -1;
+    bool m_read_ahead = false;  // not a regular file, so read in full up front
+    size_t m_chunk_bytes;
+    SpscRing<size_t> m_chunks;  // reader -> lexer: bytes read so far
+    SpscRing<Token> m_tokens;   // lexer -> parser
+    // Set by each thread before it closes its ring.
+    std::exception_ptr m_read_error;
+    std::exception_ptr m_lex_error;
+    std::thread m_reader;
+    std::thread m_lexer;
+};
@@ -0,0 +1,257 @@
+#include "result_cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// --- XXH64 ---
+
+namespace {
+
+constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;  // little-endian hosts only, like the rest of the on-disk formats
+}
+
+inline uint32_t read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof v);
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+inline uint64_t merge(uint64_t acc, uint64_t lane) {
+    return (acc ^ round(0, lane)) * PRIME1 + PRIME4;
+}
+
+} // namespace
+
+uint64_t xxhash64(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME1 + PRIME2, v2 = seed + PRIME2, v3 = seed, v4 = seed - PRIME1;
+        for (; end - p >= 32; p += 32) {
+            v1 = round(v1, read64(p));
+            v2 = round(v2, read64(p + 8));
+            v3 = round(v3, read64(p + 16));
+            v4 = round(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+    } else {
+        h = seed + PRIME5;
+    }
+    h += size;
+    for (; end - p >= 8; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    if (end - p >= 4) {
+        h = rotl(h ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; ++p) h = rotl(h ^ (*p * PRIME5), 11) * PRIME1;
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+// --- Entries ---
+
+namespace {
+
+constexpr char MAGIC[8] = {'C', 'F', 'L', 'C', 'A', 'C', 'H', 'E'};
+
+struct EntryHeader {
+    char magic[8];
+    uint64_t input_size;  // a cheap check against hash collisions
+    uint64_t out_size;
+    uint64_t err_size;
+};
+
+std::atomic<unsigned> g_temp_counter{0};
+
+} // namespace
+
+ResultCache::ResultCache(std::string dir, uint64_t max_bytes) : m_dir(std::move(dir)), m_max_bytes(max_bytes) {
+    std::error_code ec;
+    fs::create_directories(m_dir, ec);
+    if (ec || !fs::is_directory(m_dir)) {
+        throw std::runtime_error("cache error: could not create " + m_dir);
+    }
+}
+
+uint64_t ResultCache::key(const char* first, const char* last, const std::string& variant) {
+    std::string salt = variant + '\0' + CACHE_VERSION;
+    return xxhash64(first, static_cast<size_t>(last - first), xxhash64(salt.data(), salt.size(), 0));
+}
+
+std::string ResultCache::entry_path(uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof name, "%016llx", static_cast<unsigned long long>(key));
+    return m_dir + "/" + name;
+}
+
+namespace {
+
+// Reads exactly `size` bytes, retrying short reads.
+bool read_fully(int fd, char* buf, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::read(fd, buf, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+bool ResultCache::lookup(uint64_t key, size_t input_size, std::string& out, std::string& err) {
+    std::string path = entry_path(key);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ++m_misses;
+        return false;
+    }
+    struct stat st;
+    EntryHeader header;
+    bool hit = false, corrupt = true;
+    if (::fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) >= sizeof header
+        && read_fully(fd, reinterpret_cast<char*>(&header), sizeof header)) {
+        // The sizes come from the file, so check them against its length
+        // before allocating anything.
+        uint64_t body = static_cast<uint64_t>(st.st_size) - sizeof header;
+        corrupt = std::memcmp(header.magic, MAGIC, sizeof MAGIC) != 0 || header.out_size > body
+            || header.err_size != body - header.out_size;
+        if (!corrupt && header.input_size == input_size) {
+            out.resize(header.out_size);
+            err.resize(header.err_size);
+            hit = read_fully(fd, out.data(), out.size()) && read_fully(fd, err.data(), err.size());
+            corrupt = !hit;
+        }
+    }
+    ::close(fd);
+    if (!hit) {
+        // A truncated or garbled entry would miss forever; drop it so the
+        // next store replaces it.
+        if (corrupt) std::remove(path.c_str());
+        ++m_misses;
+        return false;
+    }
+    // Mark the entry as recently used for eviction.
+    ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    ++m_hits;
+    return true;
+}
+
+void ResultCache::store(uint64_t key, size_t input_size, const std::string& out, const std::string& err) {
+    std::string path = entry_path(key);
+    std::string temp = path + ".tmp." + std::to_string(::getpid()) + "." + std::to_string(g_temp_counter++);
+    EntryHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.input_size = input_size;
+    header.out_size = out.size();
+    header.err_size = err.size();
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(&header), sizeof header);
+        file.write(out.data(), out.size());
+        file.write(err.data(), err.size());
+        if (!file) {
+            file.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return;
+    }
+    ++m_stores;
+}
+
+void ResultCache::run(uint64_t key, size_t input_size, std::ostream& out, std::ostream& err, const Producer& produce) {
+    std::string cached_out, cached_err;
+    if (!lookup(key, input_size, cached_out, cached_err)) {
+        std::ostringstream fresh_out, fresh_err;
+        produce(fresh_out, fresh_err);
+        cached_out = fresh_out.str();
+        cached_err = fresh_err.str();
+        store(key, input_size, cached_out, cached_err);
+    }
+    out << cached_out;
+    err << cached_err;
+}
+
+void ResultCache::evict() {
+    if (m_stores == 0) return;
+    struct Entry {
+        fs::file_time_type used;
+        uint64_t size;
+        fs::path path;
+    };
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code ec;
+    for (const fs::directory_entry& entry : fs::directory_iterator(m_dir, ec)) {
+        std::error_code entry_ec;
+        if (!entry.is_regular_file(entry_ec)) continue;
+        uint64_t size = entry.file_size(entry_ec);
+        fs::file_time_type used = entry.last_write_time(entry_ec);
+        if (entry_ec) continue;
+        entries.push_back({used, size, entry.path()});
+        total += size;
+    }
+    if (total <= m_max_bytes) return;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+    for (const Entry& entry : entries) {
+        if (total <= m_max_bytes) break;
+        if (fs::remove(entry.path, ec)) total -= entry.size;
+    }
+}
+
+void ResultCache::report(std::ostream& os) const {
+    size_t hits = m_hits, misses = m_misses;
+    size_t lookups = hits + misses;
+    double rate = lookups == 0 ? 0.0 : 100.0 * static_cast<double>(hits) / static_cast<double>(lookups);
+    os << "cache: " << hits << (hits == 1 ? " hit, " : " hits, ") << misses << (misses == 1 ? " miss, " : " misses, ")
+       << std::fixed << std::setprecision(1) << rate << "% hit rate" << std::endl;
+}
+
+bool parse_cache_size(const std::string& arg, uint64_t& bytes) {
+    if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos) return false;
+    bytes = std::strtoull(arg.c_str(), nullptr, 10) << 20;
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+// An on-disk cache of driver output, keyed by the input.
+//
+// Each entry is one file in the cache directory, named by a 64-bit hash of
+// the input bytes and a `variant`: the tool, CACHE_VERSION and every option
+// that changes the output. An entry holds the stdout and stderr the driver
+// produced, so a hit is printed without lexing or parsing. Entries are
+// written to a temporary file and renamed into place, so concurrent runs
+// and batch workers can share a directory.
+//
+// Reading an entry refreshes its modification time, and evict() removes the
+// least recently used entries until the directory fits the size limit.
+//
+// The hash is XXH64, so a hit costs one read of the input at several GB/s
+// plus one small file read.
+class ResultCache {
+public:
+    // Bump whenever the output of lex or parse changes, so old entries miss.
+    static constexpr const char* CACHE_VERSION = "1";
+
+    // Creates `dir` if needed; throws std::runtime_error if that fails.
+    ResultCache(std::string dir, uint64_t max_bytes);
+
+    static uint64_t key(const char* first, const char* last, const std::string& variant);
+
+    // Fills `out` and `err` and returns true on a hit. An entry whose sizes
+    // do not add up to its file length is corrupt: it misses and is removed.
+    bool lookup(uint64_t key, size_t input_size, std::string& out, std::string& err);
+
+    // Best effort: a cache that can't be written to just keeps missing.
+    void store(uint64_t key, size_t input_size, const std::string& out, const std::string& err);
+
+    // Writes the cached output for `key` to `out` and `err` on a hit. On a
+    // miss, runs `produce` into buffers, stores what it wrote and then
+    // writes that.
+    using Producer = std::function<void(std::ostream& out, std::ostream& err)>;
+    void run(uint64_t key, size_t input_size, std::ostream& out, std::ostream& err, const Producer& produce);
+
+    // Removes the least recently used entries until the total size is at most
+    // the limit. Scans the directory, so call it once at the end of a run;
+    // does nothing if this run stored nothing.
+    void evict();
+
+    size_t hits() const { return m_hits; }
+    size_t misses() const { return m_misses; }
+
+    // "cache: 9 hits, 1 miss, 90.0% hit rate"
+    void report(std::ostream& os) const;
+
+private:
+    std::string m_dir;
+    uint64_t m_max_bytes;
+    std::atomic<size_t> m_hits{0};
+    std::atomic<size_t> m_misses{0};
+    std::atomic<size_t> m_stores{0};
+
+    std::string entry_path(uint64_t key) const;
+};
+
+// XXH64 of [data, data + size).
+uint64_t xxhash64(const void* data, size_t size, uint64_t seed);
+
+// Parses the argument of --cache-size, in megabytes, into bytes.
+bool parse_cache_size(const std::string& arg, uint64_t& bytes);
@@ -0,0 +1,51 @@
+#include "source_location.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+void LineIndex::build() const {
+    const size_t size = static_cast<size_t>(m_last - m_first);
+    m_line_starts.push_back(0);
+    size_t pos = 0;
+#ifdef __SSE2__
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= size; pos += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m_first + pos));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+        while (mask != 0) {
+            m_line_starts.push_back(pos + static_cast<size_t>(__builtin_ctz(mask)) + 1);
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (pos < size) {
+        const void* found = std::memchr(m_first + pos, '\n', size - pos);
+        if (!found) break;
+        pos = static_cast<size_t>(static_cast<const char*>(found) - m_first) + 1;
+        m_line_starts.push_back(pos);
+    }
+}
+
+SourceLocation LineIndex::locate(const char* p) const {
+    if (m_line_starts.empty()) build();
+    size_t offset = static_cast<size_t>(p - m_first);
+    // The last line start at or before `offset`.
+    auto it = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset) - 1;
+    return {static_cast<size_t>(it - m_line_starts.begin()) + 1, offset - *it + 1};
+}
+
+size_t LineIndex::line_count() const {
+    if (m_line_starts.empty()) build();
+    return m_line_starts.size();
+}
+
+std::optional<SourceLocation> locate(const Node& node, const NodeTokens& node_tokens,
+                                     const std::vector<Token>& tokens, const LineIndex& lines) {
+    auto it = node_tokens.find(&node);
+    if (it == node_tokens.end() || it->second >= tokens.size()) return std::nullopt;
+    return lines.locate(tokens[it->second]);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "lexer.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct Node;
+
+// A 1-based line and column; columns count bytes.
+struct SourceLocation {
+    size_t line;
+    size_t column;
+};
+
+// Maps pointers into a source buffer to lines and columns.
+//
+// Nothing is computed until the first lookup: the constructor only stores the
+// buffer, so code that never asks for a location pays nothing. The first
+// lookup finds every newline (16 bytes at a time where SSE2 is available);
+// after that each lookup is a binary search over the line starts.
+class LineIndex {
+public:
+    LineIndex(const char* first, const char* last) : m_first(first), m_last(last) {}
+
+    // `p` must point into [first, last].
+    SourceLocation locate(const char* p) const;
+    SourceLocation locate(const Token& token) const { return locate(token.first); }
+
+    size_t line_count() const;
+
+private:
+    const char* m_first;
+    const char* m_last;
+    mutable std::vector<size_t> m_line_starts;  // offsets; empty until built
+
+    void build() const;
+};
+
+// The index of the first token of each node, recorded by the parser when
+// asked to (see Parser::record_node_tokens). Interned types aren't recorded.
+using NodeTokens = std::unordered_map<const Node*, size_t>;
+
+// Where `node` starts in the buffer `lines` covers, if the parser recorded it.
+std::optional<SourceLocation> locate(const Node& node, const NodeTokens& node_tokens,
+                                     const std::vector<Token>& tokens, const LineIndex& lines);
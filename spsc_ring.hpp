@@ -0,0 +1,165 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+// A bounded queue between exactly two threads: one producer that pushes and
+// one consumer that pops. Neither side takes a lock; each owns one index and
+// only reads the other's, and keeps a cached copy of it so the shared cache
+// line is touched only when the ring looks full or empty.
+//
+// Items move in batches, so a thread pays one release/acquire pair per batch
+// rather than per item. A side that has to wait spins briefly, yields for a
+// while, and then sleeps in std::atomic::wait until the other side moves; a
+// side that moves only notifies when the other has said it is asleep.
+//
+// The producer calls close() after its last push; the consumer drains what is
+// left and then pop() returns 0. The consumer calls cancel() to give up early,
+// which makes the producer's next push() return false.
+template <typename T>
+class SpscRing {
+public:
+    // Holds `capacity` items, rounded up to a power of two.
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_mask = size - 1;
+        m_slots = std::make_unique<T[]>(size);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // --- Producer side ---
+
+    // Pushes all `count` items, waiting for room as needed. Returns false,
+    // with some items possibly dropped, if the consumer cancelled.
+    bool push(const T* items, size_t count) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (unsigned spins = 0; count > 0;) {
+            if (m_cancelled.load(std::memory_order_relaxed)) return false;
+            size_t room = capacity() - (tail - m_cached_head);
+            if (room == 0) {
+                m_cached_head = m_head.load(std::memory_order_acquire);
+                if (tail - m_cached_head == capacity() && !spin(spins)) sleep_until_popped(tail);
+                continue;
+            }
+            size_t n = count < room ? count : room;
+            for (size_t i = 0; i < n; ++i) m_slots[(tail + i) & m_mask] = items[i];
+            tail += n;
+            items += n;
+            count -= n;
+            m_tail.store(tail, std::memory_order_release);
+            wake(m_consumer_asleep, m_tail_signal);
+            spins = 0;
+        }
+        return !m_cancelled.load(std::memory_order_relaxed);
+    }
+
+    // No more pushes will follow.
+    void close() {
+        m_closed.store(true, std::memory_order_release);
+        wake(m_consumer_asleep, m_tail_signal);
+    }
+
+    // --- Consumer side ---
+
+    // Pops up to `count` items into `out`, waiting until there is at least
+    // one. Returns 0 only once the ring is closed and empty.
+    size_t pop(T* out, size_t count) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        for (unsigned spins = 0; m_cached_tail == head;) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (m_cached_tail != head) break;
+            if (m_closed.load(std::memory_order_acquire)) {
+                // Pushes before close() are visible now; take any that raced in.
+                m_cached_tail = m_tail.load(std::memory_order_acquire);
+                if (m_cached_tail == head) return 0;
+                break;
+            }
+            if (!spin(spins)) sleep_until_pushed(head);
+        }
+        size_t available = m_cached_tail - head;
+        size_t n = count < available ? count : available;
+        for (size_t i = 0; i < n; ++i) out[i] = m_slots[(head + i) & m_mask];
+        m_head.store(head + n, std::memory_order_release);
+        wake(m_producer_asleep, m_head_signal);
+        return n;
+    }
+
+    // The consumer won't pop again; unblocks a waiting producer.
+    void cancel() {
+        m_cancelled.store(true, std::memory_order_relaxed);
+        wake(m_producer_asleep, m_head_signal);
+    }
+
+private:
+    size_t capacity() const { return m_mask + 1; }
+
+    // Spins, then yields, for a while; false once it is time to sleep.
+    static bool spin(unsigned& spins) {
+        if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else if (spins < 128) {
+            std::this_thread::yield();
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // A sleeper sets its flag and then checks the index it waits on; a waker
+    // stores the index and then checks the flag. The fences between the two
+    // steps on either side make sure one of them sees the other.
+    static void wake(std::atomic<bool>& asleep, std::atomic<uint32_t>& signal) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (asleep.load(std::memory_order_relaxed)) {
+            signal.fetch_add(1, std::memory_order_release);
+            signal.notify_one();
+        }
+    }
+
+    // Sleeps while the ring is still full at `tail` and not cancelled.
+    void sleep_until_popped(size_t tail) {
+        uint32_t seen = m_head_signal.load(std::memory_order_acquire);
+        m_producer_asleep.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (tail - m_head.load(std::memory_order_relaxed) == capacity()
+                && !m_cancelled.load(std::memory_order_relaxed)) {
+            m_head_signal.wait(seen, std::memory_order_acquire);
+        }
+        m_producer_asleep.store(false, std::memory_order_relaxed);
+    }
+
+    // Sleeps while the ring is still empty at `head` and not closed.
+    void sleep_until_pushed(size_t head) {
+        uint32_t seen = m_tail_signal.load(std::memory_order_acquire);
+        m_consumer_asleep.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_tail.load(std::memory_order_relaxed) == head && !m_closed.load(std::memory_order_relaxed)) {
+            m_tail_signal.wait(seen, std::memory_order_acquire);
+        }
+        m_consumer_asleep.store(false, std::memory_order_relaxed);
+    }
+
+    // Indices count up forever and are masked on access, so full and empty
+    // are told apart without a spare slot.
+    alignas(64) std::atomic<size_t> m_head{0};  // written by the consumer
+    size_t m_cached_tail = 0;                    // the consumer's copy of m_tail
+    alignas(64) std::atomic<size_t> m_tail{0};  // written by the producer
+    size_t m_cached_head = 0;                    // the producer's copy of m_head
+    alignas(64) std::atomic<bool> m_closed{false};
+    std::atomic<bool> m_cancelled{false};
+    // Bumped and notified to wake a side that said it is asleep.
+    alignas(64) std::atomic<uint32_t> m_tail_signal{0};  // the consumer sleeps on it
+    std::atomic<bool> m_consumer_asleep{false};
+    alignas(64) std::atomic<uint32_t> m_head_signal{0};  // the producer sleeps on it
+    std::atomic<bool> m_producer_asleep{false};
+    size_t m_mask;
+    std::unique_ptr<T[]> m_slots;
+};
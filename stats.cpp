@@ -0,0 +1,130 @@
+#include "stats.hpp"
+#include "ast.hpp"
+
+#include <cstdlib>
+#include <cxxabi.h>
+#include <iomanip>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <sys/resource.h>
+
+void Stats::begin(const std::string& phase) {
+    end();
+    m_running = phase;
+    if (m_perf) m_counts_started = m_perf->read();
+    m_started = Clock::now();
+}
+
+void Stats::end() {
+    if (m_running.empty()) return;
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - m_started).count();
+    PerfCounters::Counts counts;
+    counts.fill(PerfCounters::MISSING);
+    if (m_perf) {
+        PerfCounters::Counts now = m_perf->read();
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (now[i] != PerfCounters::MISSING && m_counts_started[i] != PerfCounters::MISSING) {
+                counts[i] = now[i] - m_counts_started[i];
+            }
+        }
+    }
+    m_phases.push_back({m_running, ms, counts});
+    m_running.clear();
+}
+
+void Stats::enable_perf() {
+    m_perf = std::make_unique<PerfCounters>();
+}
+
+void Stats::report(std::ostream& os) const {
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(3);
+
+    double total_ms = 0;
+    for (const auto& [name, ms, counts] : m_phases) {
+        total_ms += ms;
+        double seconds = ms / 1000.0;
+        os << "stats: " << std::left << std::setw(8) << name << std::right << std::setw(12) << ms << " ms";
+        if (seconds > 0) {
+            os << std::setw(12) << input_bytes / 1e6 / seconds << " MB/s"
+               << std::setprecision(0) << std::setw(14) << tokens / seconds << " tokens/s"
+               << std::setprecision(3);
+        }
+        os << "\n";
+    }
+    os << "stats: " << std::left << std::setw(8) << "total" << std::right << std::setw(12) << total_ms << " ms\n";
+    os << "stats: input " << input_bytes << " bytes, " << tokens << " tokens\n";
+    os << "stats: peak RSS " << peak_rss_kb() << " KB\n";
+    if (m_perf) {
+        report_perf(os);
+    }
+    for (const auto& [type, count] : token_counts) {
+        os << "stats: token " << type << " " << count << "\n";
+    }
+    for (const auto& [kind, count] : node_counts) {
+        os << "stats: node " << kind << " " << count << "\n";
+    }
+    os.flags(flags);
+}
+
+void Stats::report_perf(std::ostream& os) const {
+    if (!m_perf->available()) {
+        os << "stats: perf unavailable (" << m_perf->error() << ")\n";
+        return;
+    }
+    if (!m_perf->error().empty()) {
+        os << "stats: perf partial (" << m_perf->error() << ")\n";
+    }
+    for (const auto& [name, ms, counts] : m_phases) {
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (counts[i] == PerfCounters::MISSING) continue;
+            os << "stats: perf " << std::left << std::setw(8) << name
+               << std::setw(14) << PerfCounters::event_name(static_cast<PerfCounters::Event>(i))
+               << std::right << std::setw(14) << counts[i] << std::setprecision(1);
+            if (input_bytes > 0) os << std::setw(16) << counts[i] / (input_bytes / 1e6) << " /MB";
+            if (tokens > 0) os << std::setprecision(3) << std::setw(12) << static_cast<double>(counts[i]) / tokens << " /token";
+            os << std::setprecision(3) << "\n";
+        }
+        uint64_t cycles = counts[PerfCounters::Cycles];
+        uint64_t instructions = counts[PerfCounters::Instructions];
+        if (cycles != PerfCounters::MISSING && instructions != PerfCounters::MISSING && cycles > 0) {
+            os << "stats: perf " << std::left << std::setw(8) << name << std::setw(14) << "IPC"
+               << std::right << std::setw(14) << static_cast<double>(instructions) / cycles << "\n";
+        }
+    }
+}
+
+// The unqualified class name of a node, e.g. "BinOp".
+static std::string kind_name(const std::type_index& type) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+    std::string name = status == 0 ? demangled : type.name();
+    std::free(demangled);
+    return name;
+}
+
+void count_nodes_by_kind(const Node& root, std::map<std::string, size_t>& counts) {
+    // Count by type first and only name the kinds that occur.
+    std::unordered_map<std::type_index, size_t> by_type;
+    std::vector<const Node*> work{&root};
+    while (!work.empty()) {
+        const Node* node = work.back();
+        work.pop_back();
+        ++by_type[typeid(*node)];
+        node->children(work);
+    }
+    for (const auto& [type, count] : by_type) {
+        counts[kind_name(type)] += count;
+    }
+}
+
+size_t peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024;  // bytes on macOS
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+}
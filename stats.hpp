@@ -0,0 +1,58 @@
+#pragma once
+
+#include "perf_counters.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct Node;
+
+// Timing and counting for the `--stats` flag of the drivers.
+//
+// Phases are timed back to back: begin() ends the running phase, if any, and
+// starts the next one. The counts are only filled in when stats are on, so
+// the drivers pay nothing else for them otherwise. With enable_perf(), each
+// phase also records hardware counters, reported per MB and per token.
+class Stats {
+public:
+    void begin(const std::string& phase);
+    void end();
+
+    // Opens the hardware counters; call before the first phase.
+    void enable_perf();
+
+    size_t input_bytes = 0;
+    size_t tokens = 0;
+    std::map<std::string, size_t> token_counts;
+    std::map<std::string, size_t> node_counts;
+
+    // Writes the report, one item per line.
+    void report(std::ostream& os) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Phase {
+        std::string name;
+        double ms;
+        PerfCounters::Counts counts;  // deltas over the phase
+    };
+    std::vector<Phase> m_phases;
+    std::string m_running;
+    Clock::time_point m_started;
+    std::unique_ptr<PerfCounters> m_perf;
+    PerfCounters::Counts m_counts_started;
+
+    void report_perf(std::ostream& os) const;
+};
+
+// Adds every node of the tree under `root` to `counts`, keyed by node kind.
+// Interned types are counted once per reference.
+void count_nodes_by_kind(const Node& root, std::map<std::string, size_t>& counts);
+
+// Peak resident set size of this process, in kilobytes.
+size_t peak_rss_kb();
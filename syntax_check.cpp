@@ -0,0 +1,400 @@
+#include "syntax_check.hpp"
+
+#include <string>
+
+// Each rule below mirrors the BasicParser rule of the same name in
+// parser.cpp, consuming the same tokens and failing at the same places
+// with the same messages; a change to the grammar there belongs here too.
+
+template <typename Source>
+void BasicSyntaxChecker<Source>::check() {
+    check_program();
+}
+
+// program ::= (struct | extern | function)+
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_program() {
+    if (is_at_end()) {
+        error("unexpected end of token stream");
+    }
+    while (!is_at_end()) {
+        if (check(TokenType::Struct)) {
+            check_struct_def();
+        } else if (check(TokenType::Extern)) {
+            check_extern_def();
+        } else if (check(TokenType::Fn)) {
+            check_function_def();
+        } else {
+            unexpected();
+        }
+    }
+}
+
+// function ::= `fn` id `(` LIST(decl) `)` `->` type `{` let⋆ stmt⋆ `}`
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_function_def() {
+    expect(TokenType::Fn);
+    expect(TokenType::Id);
+    expect(TokenType::OpenParen);
+    if (!check(TokenType::CloseParen)) {
+        do {
+            check_decl();
+        } while (check(TokenType::Comma) && (advance(), true));
+    }
+    expect(TokenType::CloseParen);
+    expect(TokenType::Arrow);
+    check_type();
+    expect(TokenType::OpenBrace);
+
+    // let ::= `let` LIST(decl) `;`
+    while (check(TokenType::Let)) {
+        expect(TokenType::Let);
+        if (!check(TokenType::Semicolon)) {
+            do {
+                check_decl();
+            } while (check(TokenType::Comma) && (advance(), true));
+        }
+        expect(TokenType::Semicolon);
+    }
+
+    while (!check(TokenType::CloseBrace) && !is_at_end()) {
+        check_stmt();
+    }
+    expect(TokenType::CloseBrace);
+}
+
+// decl ::= id `:` type
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_decl() {
+    expect(TokenType::Id);
+    expect(TokenType::Colon);
+    check_type();
+}
+
+// stmt ::= exp (`=` exp)? `;` | `if`... | `while`... | `break`... | `continue`... | `return`...
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_stmt() {
+    if (check(TokenType::If)) return check_if_stmt();
+    if (check(TokenType::While)) return check_while_stmt();
+    if (check(TokenType::Return)) return check_return_stmt();
+
+    if (check(TokenType::Break) || check(TokenType::Continue)) {
+        advance();
+        expect(TokenType::Semicolon);
+        return;
+    }
+
+    // exp (`=` exp)? `;`
+    // The left-hand side of an assignment must be a Place.
+    if (is_at_end()) {
+        error("unexpected end of token stream");
+    }
+    size_t start_index = position();
+    Token start_token = m_tokens.token();
+    ExpKind left = check_exp();
+
+    if (check(TokenType::Gets)) {
+        advance();
+        check_exp();
+        expect(TokenType::Semicolon);
+        if (left != ExpKind::Place) {
+            error_at(start_index, start_token, "left-hand side of assignment must be a place, starting at token " + std::to_string(start_index));
+        }
+    } else {
+        expect(TokenType::Semicolon);
+        if (left != ExpKind::Call) {
+            error_at(start_index, start_token, "standalone expressions must be function calls, starting at token " + std::to_string(start_index));
+        }
+    }
+}
+
+// `if` exp block (`else` block)?
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_if_stmt() {
+    expect(TokenType::If);
+    check_exp();
+    check_block();
+    if (check(TokenType::Else)) {
+        advance();
+        check_block();
+    }
+}
+
+// block ::= `{` stmt⋆ `}`
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_block() {
+    expect(TokenType::OpenBrace);
+    while (!check(TokenType::CloseBrace) && !is_at_end()) {
+        check_stmt();
+    }
+    expect(TokenType::CloseBrace);
+}
+
+// `while` exp block
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_while_stmt() {
+    expect(TokenType::While);
+    check_exp();
+    check_block();
+}
+
+// `return` exp `;`
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_return_stmt() {
+    expect(TokenType::Return);
+    check_exp();
+    expect(TokenType::Semicolon);
+}
+
+// --- Expressions ---
+// Every operator makes an Other; only exp6 and exp7 make places and calls.
+
+// exp  ::= exp1 (`?` exp `:` exp1)⋆
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp() {
+    ExpKind kind = check_exp1();
+    while (check(TokenType::QuestionMark)) {
+        advance();
+        check_exp();
+        expect(TokenType::Colon);
+        check_exp1();
+        kind = ExpKind::Other;
+    }
+    return kind;
+}
+
+// exp1 ::= exp2 ([`and`,`or`] exp2)⋆, right-associative
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp1() {
+    ExpKind kind = check_exp2();
+    if (check(TokenType::And) || check(TokenType::Or)) {
+        advance();
+        check_exp1();
+        return ExpKind::Other;
+    }
+    return kind;
+}
+
+// exp2 ::= exp3 ([`==`,`!=`,`<`,`<=`,`>`,`>=`] exp3)⋆
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp2() {
+    ExpKind kind = check_exp3();
+    while (check(TokenType::Equal) || check(TokenType::NotEq) || check(TokenType::Lt)
+            || check(TokenType::Lte) || check(TokenType::Gt) || check(TokenType::Gte)) {
+        advance();
+        check_exp3();
+        kind = ExpKind::Other;
+    }
+    return kind;
+}
+
+// exp3 ::= exp4 ((`+`|`-`) exp4)*
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp3() {
+    ExpKind kind = check_exp4();
+    while (check(TokenType::Plus) || check(TokenType::Dash)) {
+        advance();
+        check_exp4();
+        kind = ExpKind::Other;
+    }
+    return kind;
+}
+
+// exp4 ::= exp5 ((`*`|`/`) exp5)*
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp4() {
+    ExpKind kind = check_exp5();
+    while (check(TokenType::Star) || check(TokenType::Slash)) {
+        advance();
+        check_exp5();
+        kind = ExpKind::Other;
+    }
+    return kind;
+}
+
+// exp5 ::= unop⋆ exp6
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp5() {
+    if (check(TokenType::Dash) || check(TokenType::Not)) {
+        advance();
+        check_exp5();
+        return ExpKind::Other;
+    }
+    return check_exp6();
+}
+
+// exp6 ::= exp7 call_or_access⋆
+// call_or_access ::= `[` exp `]` | `.` (id | `*`) | `(` LIST(exp) `)`
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp6() {
+    ExpKind kind = check_exp7();
+    while (true) {
+        if (check(TokenType::OpenBracket)) {
+            advance();
+            check_exp();
+            expect(TokenType::CloseBracket);
+            kind = ExpKind::Place;
+        } else if (check(TokenType::Dot)) {
+            advance();
+            if (check(TokenType::Id) || check(TokenType::Star)) {
+                advance();
+                kind = ExpKind::Place;
+            } else {
+                unexpected();
+            }
+        } else if (check(TokenType::OpenParen)) {
+            advance();
+            if (!check(TokenType::CloseParen)) {
+                do {
+                    check_exp();
+                } while (check(TokenType::Comma) && (advance(), true));
+            }
+            expect(TokenType::CloseParen);
+            kind = ExpKind::Call;
+        } else {
+            return kind;
+        }
+    }
+}
+
+// exp7 ::= id | num | `nil` | `new` type | `[` type `;` exp `]` | `(` exp `)`
+template <typename Source>
+typename BasicSyntaxChecker<Source>::ExpKind BasicSyntaxChecker<Source>::check_exp7() {
+    if (check(TokenType::Id)) {
+        advance();
+        return ExpKind::Place;
+    }
+    if (check(TokenType::Num)) {
+        advance();
+        Token num_token = m_tokens.previous();
+        if (num_token.overflow()) {
+            error_at(position() - 1, num_token, "invalid i64 number " + std::string(num_token.first, num_token.last) + " at token " + std::to_string(position() - 1));
+        }
+        return ExpKind::Other;
+    }
+    if (check(TokenType::Nil)) {
+        advance();
+        return ExpKind::Other;
+    }
+    if (check(TokenType::New)) {
+        advance();
+        check_type();
+        return ExpKind::Other;
+    }
+    if (check(TokenType::OpenBracket)) {
+        advance();
+        check_type();
+        expect(TokenType::Semicolon);
+        check_exp();
+        expect(TokenType::CloseBracket);
+        return ExpKind::Other;
+    }
+    if (check(TokenType::OpenParen)) {
+        // The parser returns the inner node itself, so `(f());` is a call.
+        advance();
+        ExpKind kind = check_exp();
+        expect(TokenType::CloseParen);
+        return kind;
+    }
+    unexpected();
+    return ExpKind::Other; // Unreachable
+}
+
+// type ::= `int` | id | `&` type | `[` type `]` | funtype
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_type() {
+    if (check(TokenType::Int) || check(TokenType::Id)) {
+        advance();
+    } else if (check(TokenType::Ampersand)) {
+        advance();
+        check_type();
+    } else if (check(TokenType::OpenBracket)) {
+        advance();
+        check_type();
+        expect(TokenType::CloseBracket);
+    } else {
+        check_funtype();
+    }
+}
+
+// funtype ::= `(` LIST(type) `)` `->` type
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_funtype() {
+    expect(TokenType::OpenParen);
+    if (!check(TokenType::CloseParen)) {
+        do {
+            check_type();
+        } while (check(TokenType::Comma) && (advance(), true));
+    }
+    expect(TokenType::CloseParen);
+    expect(TokenType::Arrow);
+    check_type();
+}
+
+// `struct` id `{` LIST(decl) `}`
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_struct_def() {
+    expect(TokenType::Struct);
+    expect(TokenType::Id);
+    expect(TokenType::OpenBrace);
+    if (!check(TokenType::CloseBrace)) {
+        do {
+            check_decl();
+        } while (check(TokenType::Comma) && (advance(), true));
+    }
+    expect(TokenType::CloseBrace);
+}
+
+// extern ::= `extern` id `:` funtype `;`
+template <typename Source>
+void BasicSyntaxChecker<Source>::check_extern_def() {
+    expect(TokenType::Extern);
+    expect(TokenType::Id);
+    expect(TokenType::Colon);
+    check_funtype();
+    expect(TokenType::Semicolon);
+}
+
+// --- Helpers ---
+
+template <typename Source>
+void BasicSyntaxChecker<Source>::expect(TokenType type) {
+    if (is_at_end()) {
+        error("unexpected end of token stream");
+    }
+    if (m_tokens.type() != type) {
+        unexpected();
+    }
+    m_tokens.advance();
+}
+
+template <typename Source>
+void BasicSyntaxChecker<Source>::unexpected() {
+    if (is_at_end()) {
+        error("unexpected end of token stream");
+    }
+    error("unexpected token at token " + std::to_string(position()));
+}
+
+// Where BasicParser::error puts an error, so the two report the same token.
+template <typename Source>
+void BasicSyntaxChecker<Source>::error(const std::string& message) const {
+    if (m_tokens.has_current()) {
+        error_at(position(), m_tokens.token(), message);
+    }
+    if (position() == 0) {
+        error_at(0, Token{}, message);
+    }
+    error_at(position() - 1, m_tokens.previous(), message);
+}
+
+template <typename Source>
+void BasicSyntaxChecker<Source>::error_at(size_t token, const Token& at, const std::string& message) const {
+    throw ParseError("parse error: " + message, token, at);
+}
+
+template class BasicSyntaxChecker<VectorSource>;
+template class BasicSyntaxChecker<SoaSource>;
+template class BasicSyntaxChecker<MappedSource>;
+template class BasicSyntaxChecker<FeedSource>;
+template class BasicSyntaxChecker<LazyLexSource>;
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "token_source.hpp"
+
+// Checks that tokens parse without building the AST, e.g. for a pre-commit
+// hook that only needs to know whether each file is valid.
+//
+// It runs the grammar of BasicParser rule for rule, including the checks in
+// parse_stmt that an assignment's left side is a place and that a
+// standalone expression is a call. Instead of nodes, each expression rule
+// returns what kind of expression it parsed, which is all those checks
+// look at. Nothing is allocated unless there is an error, and then check()
+// throws the same ParseError, message, index and token, that parse() would.
+template <typename Source>
+class BasicSyntaxChecker {
+public:
+    explicit BasicSyntaxChecker(Source tokens) : m_tokens(std::move(tokens)) {}
+
+    // The number of tokens consumed so far: all of them once check() returned.
+    size_t tokens_read() const { return m_tokens.position(); }
+
+    // Returns if the tokens are a program; throws ParseError otherwise.
+    void check();
+
+private:
+    // What parse_stmt needs to know about an expression's node.
+    enum class ExpKind {
+        Place,  // a Val, which can be assigned to
+        Call,   // a CallExp, which can stand alone
+        Other,
+    };
+
+    Source m_tokens;
+
+    bool is_at_end() { return m_tokens.at_end(); }
+    size_t position() const { return m_tokens.position(); }
+    bool check(TokenType type) { return !m_tokens.at_end() && m_tokens.type() == type; }
+    void advance() {
+        if (!is_at_end()) m_tokens.advance();
+    }
+    // BasicParser::consume with its usual "unexpected token" message, which
+    // is only put together if the token doesn't match.
+    void expect(TokenType type);
+    // Throws the error for the current token, or for the end of the stream,
+    // as BasicParser does where it reads current_index().
+    void unexpected();
+    void error(const std::string& message) const;
+    void error_at(size_t token, const Token& at, const std::string& message) const;
+
+    void check_program();
+    void check_struct_def();
+    void check_extern_def();
+    void check_function_def();
+    void check_decl();
+    void check_stmt();
+    void check_if_stmt();
+    void check_while_stmt();
+    void check_return_stmt();
+    void check_block();
+    void check_type();
+    void check_funtype();
+    ExpKind check_exp();
+    ExpKind check_exp1();
+    ExpKind check_exp2();
+    ExpKind check_exp3();
+    ExpKind check_exp4();
+    ExpKind check_exp5();
+    ExpKind check_exp6();
+    ExpKind check_exp7();
+};
+
+using SyntaxChecker = BasicSyntaxChecker<VectorSource>;
+
+extern template class BasicSyntaxChecker<VectorSource>;
+extern template class BasicSyntaxChecker<SoaSource>;
+extern template class BasicSyntaxChecker<MappedSource>;
+extern template class BasicSyntaxChecker<FeedSource>;
+extern template class BasicSyntaxChecker<LazyLexSource>;
@@ -0,0 +1,119 @@
+#include "token_file.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace token_file {
+
+static const char MAGIC[8] = {'C', 'F', 'L', 'A', 'T', 'T', 'O', 'K'};
+static const uint32_t VERSION = 1;
+
+// Bytes of the columns for `count` tokens, `types` padded to 8 bytes.
+static size_t column_bytes(uint64_t count) {
+    size_t types = (count + 7) & ~size_t(7);
+    return count * (sizeof(int64_t) + 2 * sizeof(uint32_t)) + types;
+}
+
+// --- Loading ---
+
+TokenFile::TokenFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("token file error: could not open " + path);
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(TokenFileHeader)) {
+        ::close(fd);
+        throw std::runtime_error("token file error: " + path + " is too small");
+    }
+    m_size = static_cast<size_t>(st.st_size);
+    m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m_data == MAP_FAILED) {
+        m_data = nullptr;
+        throw std::runtime_error("token file error: could not map " + path);
+    }
+
+    const TokenFileHeader* header = static_cast<const TokenFileHeader*>(m_data);
+    bool valid = std::memcmp(header->magic, MAGIC, sizeof MAGIC) == 0
+        && header->version == VERSION
+        && header->count <= m_size && header->source_bytes <= m_size
+        && sizeof(TokenFileHeader) + column_bytes(header->count) + header->source_bytes == m_size;
+    if (!valid) {
+        ::munmap(m_data, m_size);
+        m_data = nullptr;
+        throw std::runtime_error("token file error: " + path + " is not a valid token file");
+    }
+
+    m_count = header->count;
+    m_source_bytes = header->source_bytes;
+    m_values = reinterpret_cast<const int64_t*>(header + 1);
+    m_firsts = reinterpret_cast<const uint32_t*>(m_values + m_count);
+    m_lasts = m_firsts + m_count;
+    m_types = reinterpret_cast<const uint8_t*>(m_lasts + m_count);
+    m_source = reinterpret_cast<const char*>(header + 1) + column_bytes(m_count);
+
+    // Checked once here so the parser can trust every token.
+    for (size_t i = 0; i < m_count; ++i) {
+        if (m_firsts[i] > m_lasts[i] || m_lasts[i] > m_source_bytes
+                || m_types[i] > static_cast<uint8_t>(TokenType::QuestionMark)) {
+            ::munmap(m_data, m_size);
+            m_data = nullptr;
+            throw std::runtime_error("token file error: " + path + " is not a valid token file");
+        }
+    }
+}
+
+TokenFile::~TokenFile() {
+    if (m_data) ::munmap(m_data, m_size);
+}
+
+// --- Writing ---
+
+void write_token_file(const std::string& path, const char* first, const char* last, const std::vector<Token>& tokens) {
+    size_t source_bytes = static_cast<size_t>(last - first);
+    if (source_bytes > UINT32_MAX) {
+        throw std::runtime_error("token file error: " + path + ": source too large");
+    }
+
+    std::vector<int64_t> values;
+    std::vector<uint32_t> offsets;  // firsts, then lasts
+    std::string types;
+    values.reserve(tokens.size());
+    offsets.resize(2 * tokens.size());
+    types.reserve(tokens.size() + 8);
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        values.push_back(tokens[i].value);
+        offsets[i] = static_cast<uint32_t>(tokens[i].first - first);
+        offsets[tokens.size() + i] = static_cast<uint32_t>(tokens[i].last - first);
+        types.push_back(static_cast<char>(tokens[i].token_type));
+    }
+    types.resize((types.size() + 7) & ~size_t(7), '\0');
+
+    TokenFileHeader header{};
+    std::memcpy(header.magic, MAGIC, sizeof MAGIC);
+    header.version = VERSION;
+    header.count = tokens.size();
+    header.source_bytes = source_bytes;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("token file error: could not create " + path);
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof header);
+    out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int64_t));
+    out.write(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    out.write(types.data(), types.size());
+    out.write(first, source_bytes);
+    if (!out) {
+        throw std::runtime_error("token file error: could not write " + path);
+    }
+}
+
+} // namespace token_file
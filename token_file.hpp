@@ -0,0 +1,71 @@
+#pragma once
+
+#include "lexer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary token files
+//
+// The tokens of one source file together with the source itself, laid out so
+// the file can be mapped with `mmap` and parsed in place: nothing is read or
+// converted up front, and a token is put together from its columns only when
+// the parser reaches it. Keeping the source lets the tokens point into it, so
+// Id names and error locations work as with freshly lexed tokens.
+//
+// Layout (all integers little-endian, every column 8-byte aligned):
+//
+//   TokenFileHeader
+//   int64_t  values[count]       Token::value
+//   uint32_t firsts[count]       byte offsets of the tokens in the source
+//   uint32_t lasts[count]
+//   uint8_t  types[count]        TokenType
+//   char     source[source_bytes], after padding `types` to 8 bytes
+namespace token_file {
+
+struct TokenFileHeader {
+    char magic[8];            // "CFLATTOK"
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t count;           // tokens
+    uint64_t source_bytes;
+};
+
+// A token file mapped into memory. The mapping lives as long as the object.
+class TokenFile {
+public:
+    // Maps the token file at `path`; throws std::runtime_error if it is
+    // missing or malformed.
+    explicit TokenFile(const std::string& path);
+    ~TokenFile();
+
+    TokenFile(const TokenFile&) = delete;
+    TokenFile& operator=(const TokenFile&) = delete;
+
+    size_t size() const { return m_count; }
+    TokenType type(size_t i) const { return static_cast<TokenType>(m_types[i]); }
+    Token token(size_t i) const {
+        return Token{type(i), m_source + m_firsts[i], m_source + m_lasts[i], m_values[i]};
+    }
+
+    const char* source_begin() const { return m_source; }
+    const char* source_end() const { return m_source + m_source_bytes; }
+
+private:
+    void* m_data = nullptr;
+    size_t m_size = 0;
+    size_t m_count = 0;
+    size_t m_source_bytes = 0;
+    const int64_t* m_values = nullptr;
+    const uint32_t* m_firsts = nullptr;
+    const uint32_t* m_lasts = nullptr;
+    const uint8_t* m_types = nullptr;
+    const char* m_source = nullptr;
+};
+
+// Writes `tokens`, which point into [first, last), and the source to `path`;
+// throws std::runtime_error on I/O failure or a source over 4 GB.
+void write_token_file(const std::string& path, const char* first, const char* last, const std::vector<Token>& tokens);
+
+} // namespace token_file
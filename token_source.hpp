@@ -0,0 +1,218 @@
+#pragma once
+
+#include "coroutine_generator.hpp"
+#include "lexer.hpp"
+#include "token_file.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Token sources: where a BasicParser (parser.hpp) gets its tokens from.
+//
+// The parser is a template over its source, so each of these is compiled
+// into its own copy of the parser with the calls below inlined; there are no
+// virtual calls per token and no bounds-checked accesses. A source is a
+// cursor over a token stream with this interface:
+//
+//     bool at_end();              // no token at position(); may pull more first
+//     bool has_current() const;   // a token at position(), without pulling
+//     TokenType type() const;     // of the current token
+//     Token token() const;        // the current token
+//     void advance();             // on to the next token
+//     Token previous() const;     // the token before position()
+//     size_t position() const;    // the index of the current token
+//
+// type(), token() and advance() need a current token, and previous() one to
+// have been advanced past. Only the parser's own helpers call these, and they
+// check first.
+
+// A vector of tokens, e.g. from lex() or tokenize_input. The vector is
+// shared so that deferred function bodies can keep pointing into it after
+// the parser is gone (BasicParser::defer_function_bodies).
+class VectorSource {
+public:
+    VectorSource(std::vector<Token> tokens)
+        : m_tokens(std::make_shared<const std::vector<Token>>(std::move(tokens))),
+          m_data(m_tokens->data()), m_size(m_tokens->size()) {}
+
+    bool at_end() const { return m_pos >= m_size; }
+    bool has_current() const { return m_pos < m_size; }
+    TokenType type() const { return m_data[m_pos].token_type; }
+    Token token() const { return m_data[m_pos]; }
+    void advance() { ++m_pos; }
+    Token previous() const { return m_data[m_pos - 1]; }
+    size_t position() const { return m_pos; }
+
+    const std::shared_ptr<const std::vector<Token>>& shared_tokens() const { return m_tokens; }
+
+private:
+    std::shared_ptr<const std::vector<Token>> m_tokens;
+    const Token* m_data;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+// A range of tokens held elsewhere, numbered from `base` so they keep the
+// indices they had in the whole stream, e.g. the body of a function whose
+// parsing was deferred. The tokens must outlive the source.
+class SpanSource {
+public:
+    SpanSource(const Token* first, const Token* last, size_t base) : m_first(first), m_last(last), m_pos(first), m_base(base) {}
+
+    bool at_end() const { return m_pos == m_last; }
+    bool has_current() const { return m_pos != m_last; }
+    TokenType type() const { return m_pos->token_type; }
+    Token token() const { return *m_pos; }
+    void advance() { ++m_pos; }
+    Token previous() const { return m_pos[-1]; }
+    size_t position() const { return m_base + static_cast<size_t>(m_pos - m_first); }
+
+private:
+    const Token* m_first;
+    const Token* m_last;
+    const Token* m_pos;
+    size_t m_base;
+};
+
+// Tokens stored column by column: the parser mostly looks only at types,
+// and here those are a dense byte array rather than one field in every
+// 32-byte Token.
+class TokenBuffer {
+public:
+    TokenBuffer() = default;
+    explicit TokenBuffer(const std::vector<Token>& tokens) {
+        reserve(tokens.size());
+        for (const Token& token : tokens) push_back(token);
+    }
+
+    void reserve(size_t n) {
+        m_types.reserve(n);
+        m_firsts.reserve(n);
+        m_lasts.reserve(n);
+        m_values.reserve(n);
+    }
+    void push_back(const Token& token) {
+        m_types.push_back(static_cast<uint8_t>(token.token_type));
+        m_firsts.push_back(token.first);
+        m_lasts.push_back(token.last);
+        m_values.push_back(token.value);
+    }
+
+    size_t size() const { return m_types.size(); }
+    TokenType type(size_t i) const { return static_cast<TokenType>(m_types[i]); }
+    Token token(size_t i) const { return Token{type(i), m_firsts[i], m_lasts[i], m_values[i]}; }
+
+private:
+    std::vector<uint8_t> m_types;
+    std::vector<const char*> m_firsts;
+    std::vector<const char*> m_lasts;
+    std::vector<int64_t> m_values;
+};
+
+// Tokens read from the columns of a TokenBuffer or a mapped TokenFile,
+// which must outlive the source.
+template <typename Columns>
+class ColumnSource {
+public:
+    ColumnSource(const Columns& columns) : m_columns(&columns), m_size(columns.size()) {}
+
+    bool at_end() const { return m_pos >= m_size; }
+    bool has_current() const { return m_pos < m_size; }
+    TokenType type() const { return m_columns->type(m_pos); }
+    Token token() const { return m_columns->token(m_pos); }
+    void advance() { ++m_pos; }
+    Token previous() const { return m_columns->token(m_pos - 1); }
+    size_t position() const { return m_pos; }
+
+private:
+    const Columns* m_columns;
+    size_t m_size;
+    size_t m_pos = 0;
+};
+
+using SoaSource = ColumnSource<TokenBuffer>;
+using MappedSource = ColumnSource<token_file::TokenFile>;
+
+// Hands a parser its tokens a batch at a time, for parsing that starts
+// before lexing is done (see pipeline.hpp).
+class TokenFeed {
+public:
+    virtual ~TokenFeed() = default;
+    // Appends at least one token to `tokens` and returns true, or returns
+    // false once there are no more. May throw, e.g. if the input failed.
+    virtual bool more(std::vector<Token>& tokens) = 0;
+};
+
+// Tokens from a TokenFeed, one virtual call per batch. Holds only the
+// current batch and the token before it, so memory doesn't grow with the
+// input. The feed must outlive the source.
+class FeedSource {
+public:
+    FeedSource(TokenFeed& feed) : m_feed(&feed) {}
+
+    bool at_end() { return m_pos >= m_tokens.size() && !pull(); }
+    bool has_current() const { return m_pos < m_tokens.size(); }
+    TokenType type() const { return m_tokens[m_pos].token_type; }
+    Token token() const { return m_tokens[m_pos]; }
+    void advance() { ++m_pos; }
+    Token previous() const { return m_tokens[m_pos - 1]; }
+    size_t position() const { return m_base + m_pos; }
+
+private:
+    // Replaces the used-up batch with the next one, keeping its last token
+    // for previous().
+    bool pull() {
+        if (m_tokens.size() > 1) {
+            m_base += m_tokens.size() - 1;
+            m_tokens.erase(m_tokens.begin(), m_tokens.end() - 1);
+            m_pos = 1;
+        }
+        return m_feed->more(m_tokens);
+    }
+
+    TokenFeed* m_feed;
+    std::vector<Token> m_tokens;  // the current batch and the token before it
+    size_t m_pos = 0;             // into m_tokens
+    size_t m_base = 0;            // the index of m_tokens[0] in the whole stream
+};
+
+// Tokens pulled one at a time from a generator such as lex_lazily(), so
+// lexing runs only as far ahead as the parser has looked: two tokens, the
+// current one and the one before it, are all that is ever held.
+class LazyLexSource {
+public:
+    LazyLexSource(Generator<Token> tokens) : m_tokens(std::move(tokens)) {}
+
+    bool at_end() {
+        if (!m_has_current && !m_done) {
+            if (m_tokens.next()) {
+                m_current = m_tokens.value();
+                m_has_current = true;
+            } else {
+                m_done = true;
+            }
+        }
+        return !m_has_current;
+    }
+    bool has_current() const { return m_has_current; }
+    TokenType type() const { return m_current.token_type; }
+    Token token() const { return m_current; }
+    void advance() {
+        m_previous = m_current;
+        m_has_current = false;
+        ++m_pos;
+    }
+    Token previous() const { return m_previous; }
+    size_t position() const { return m_pos; }
+
+private:
+    Generator<Token> m_tokens;
+    Token m_current{};
+    Token m_previous{};
+    bool m_has_current = false;
+    bool m_done = false;
+    size_t m_pos = 0;
+};
@@ -0,0 +1,88 @@
+#include "watch.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatcher::FileWatcher(std::vector<std::string> paths) : m_paths(std::move(paths)) {
+    m_fd = inotify_init1(IN_CLOEXEC);
+    if (m_fd < 0) throw std::runtime_error(std::string("watch error: inotify_init1 failed: ") + std::strerror(errno));
+    for (size_t i = 0; i < m_paths.size(); ++i) {
+        const std::string& path = m_paths[i];
+        size_t slash = path.find_last_of('/');
+        std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+        std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+        // Watching a directory twice returns the same descriptor.
+        int wd = inotify_add_watch(m_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            std::string reason = std::strerror(errno);
+            ::close(m_fd);
+            throw std::runtime_error("watch error: could not watch " + dir + ": " + reason);
+        }
+        m_files[{wd, name}].push_back(i);
+    }
+}
+
+FileWatcher::~FileWatcher() {
+    ::close(m_fd);
+}
+
+void FileWatcher::read_events(std::vector<bool>& written) {
+    alignas(inotify_event) char buffer[16 * 1024];
+    ssize_t n = ::read(m_fd, buffer, sizeof buffer);
+    if (n < 0) {
+        if (errno == EINTR) return;
+        throw std::runtime_error(std::string("watch error: read failed: ") + std::strerror(errno));
+    }
+    for (char* p = buffer; p < buffer + n;) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+        p += sizeof(inotify_event) + event->len;
+        if (event->len == 0) continue;
+        auto it = m_files.find({event->wd, event->name});
+        if (it == m_files.end()) continue;
+        for (size_t index : it->second) written[index] = true;
+    }
+}
+
+std::vector<size_t> FileWatcher::wait() {
+    std::vector<bool> written(m_paths.size());
+    std::vector<size_t> changed;
+    while (changed.empty()) {
+        read_events(written);
+        // Take whatever else is already queued, so a save that touches several
+        // files comes back as one batch.
+        pollfd pending{m_fd, POLLIN, 0};
+        while (::poll(&pending, 1, 0) > 0) read_events(written);
+        for (size_t i = 0; i < written.size(); ++i) {
+            if (written[i]) changed.push_back(i);
+        }
+    }
+    return changed;
+}
+
+void run_watch(const std::vector<std::string>& paths, std::ostream& out, std::ostream& err, const WatchProcess& process) {
+    // Set up before the first pass, so a save during it isn't missed.
+    FileWatcher watcher(paths);
+    std::vector<std::string> printed(paths.size());
+    std::vector<std::string> reported(paths.size());
+    auto update = [&](size_t index) {
+        std::ostringstream file_out, file_err;
+        if (!process(index, file_out, file_err)) return;
+        std::string text = file_out.str();
+        std::string diagnostics = file_err.str();
+        if (text == printed[index] && diagnostics == reported[index]) return;
+        out << "==> " << paths[index] << " <==\n" << text << std::flush;
+        err << diagnostics << std::flush;
+        printed[index] = std::move(text);
+        reported[index] = std::move(diagnostics);
+    };
+
+    for (size_t i = 0; i < paths.size(); ++i) update(i);
+    for (;;) {
+        for (size_t index : watcher.wait()) update(index);
+    }
+}
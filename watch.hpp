@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Watch mode for the drivers: process a set of files, then again whenever
+// one of them is saved, until killed.
+
+// Reports writes to a set of files through inotify.
+//
+// The watches are on the files' directories rather than the files, so a
+// save that writes a new file and renames it over the old one is seen like
+// one that writes in place. Linux only. Throws std::runtime_error if the
+// watches can't be set up.
+class FileWatcher {
+public:
+    explicit FileWatcher(std::vector<std::string> paths);
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Blocks until at least one file has been written, then returns the
+    // indices of every file written since the last call, in order, each once.
+    std::vector<size_t> wait();
+
+private:
+    int m_fd;
+    std::vector<std::string> m_paths;
+    // (directory watch, file name) to the indices of the paths naming it.
+    std::map<std::pair<int, std::string>, std::vector<size_t>> m_files;
+
+    void read_events(std::vector<bool>& written);
+};
+
+// Processes `paths` once, then each file again every time it's written.
+//
+// `process` writes the output and diagnostics for the file at `index`; it
+// returns false when the file is the same as the last time it was processed
+// and it wrote nothing. Each result is printed under a "==> path <==" header,
+// but only if it differs from what was printed for that file before, so
+// saving a file without changing what it means prints nothing. Never returns;
+// throws std::runtime_error if the files can't be watched.
+using WatchProcess = std::function<bool(size_t index, std::ostream& out, std::ostream& err)>;
+void run_watch(const std::vector<std::string>& paths, std::ostream& out, std::ostream& err, const WatchProcess& process);